@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace eosiosystem { namespace bancor {
+
+   typedef unsigned __int128 uint128_t;
+
+   /**
+    *  Fixed-point Bancor math on 128-bit integers, used by the RAM market and REX in place of
+    *  the double precision formulas when FIXED_POINT_BANCOR is set.
+    *
+    *  Every function computes the exact floor of the same real-valued expression that the
+    *  floating point code truncates, so results are off from the true value by less than one
+    *  token unit and are bit-for-bit reproducible. The floating point results carry the
+    *  additional rounding error of std::pow and division; over the parameter space of the RAM
+    *  market and REX both agree to within one unit (see tests/bancor_math_bench_tests.cpp).
+    *
+    *  The functions return false when an input is outside their domain (negative amounts, an
+    *  empty connector) or an intermediate would overflow 128 bits, in which case the caller
+    *  falls back to the floating point formula. This header only depends on the standard
+    *  library so it can be exercised natively.
+    */
+
+   /**
+    *  Integer square root, floor( sqrt(x) ), by Newton's iteration from a power of two that is
+    *  not below the root; the iterates decrease monotonically to the floor.
+    */
+   inline uint64_t isqrt( uint128_t x ) {
+      if( x < 2 )
+         return uint64_t(x);
+
+      int bits = 0;
+      for( uint128_t y = x; y != 0; y >>= 8 )
+         bits += 8;
+      uint128_t r = uint128_t(1) << ((bits + 1) / 2);
+      while( true ) {
+         const uint128_t next = (r + x / r) >> 1;
+         if( next >= r )
+            return uint64_t(r);
+         r = next;
+      }
+   }
+
+   /**
+    *  Exchange tokens issued for depositing `in` to a connector of weight 0.5, as in
+    *  exchange_state::convert_to_exchange:
+    *
+    *     issued = floor( R * (sqrt(1 + T/C) - 1) ) = isqrt( floor(R^2 * (C + T) / C) ) - R
+    *
+    *  with R = supply, C = connector balance including `in` and T = in.
+    */
+   inline bool half_weight_issue( int64_t supply, int64_t balance, int64_t in, int64_t& issued ) {
+      if( supply < 0 || balance <= 0 || in < 0 )
+         return false;
+
+      const uint128_t R = uint64_t(supply);
+      const uint128_t C = uint64_t(balance);
+      const uint128_t T = uint64_t(in);
+
+      // R^2 * T / C = q * T + r * T / C, where R^2 = q * C + r and r * T < 2^126
+      const uint128_t R2 = R * R;
+      const uint128_t q  = R2 / C;
+      const uint128_t r  = R2 % C;
+
+      uint128_t qT = 0, A = 0;
+      if( __builtin_mul_overflow( q, T, &qT ) ||
+          __builtin_add_overflow( R2, qT, &A ) ||
+          __builtin_add_overflow( A, r * T / C, &A ) )
+         return false;
+
+      const uint128_t E = isqrt( A ) - R;
+      if( E > uint128_t(std::numeric_limits<int64_t>::max()) )
+         return false;
+
+      issued = int64_t(E);
+      return true;
+   }
+
+   /**
+    *  Connector tokens paid out for redeeming `in` exchange tokens from a connector of weight
+    *  0.5, as in exchange_state::convert_from_exchange:
+    *
+    *     out = floor( C * ((1 + E/R)^2 - 1) ) = floor( C * S^2 / R^2 ) - C
+    *
+    *  with S = supply, R = S - in, C = connector balance and E = in.
+    */
+   inline bool half_weight_redeem( int64_t supply, int64_t balance, int64_t in, int64_t& out ) {
+      if( in < 0 || supply <= in || balance < 0 )
+         return false;
+
+      const uint128_t S = uint64_t(supply);
+      const uint128_t R = uint64_t(supply - in);
+      const uint128_t C = uint64_t(balance);
+
+      // C * S^2 / R = C * q + C * r / R, where S^2 = q * R + r and C * r < 2^126;
+      // floor( floor(x / R) / R ) = floor( x / R^2 ) for the second division
+      const uint128_t S2 = S * S;
+      const uint128_t q  = S2 / R;
+      const uint128_t r  = S2 % R;
+
+      uint128_t Cq = 0, X = 0;
+      if( __builtin_mul_overflow( C, q, &Cq ) ||
+          __builtin_add_overflow( Cq, C * r / R, &X ) )
+         return false;
+
+      const uint128_t T = X / R - C;
+      if( T > uint128_t(std::numeric_limits<int64_t>::max()) )
+         return false;
+
+      out = int64_t(T);
+      return true;
+   }
+
+   /**
+    *  Output of the constant product formula used by REX (see get_bancor_output):
+    *
+    *     out = floor( in * conout / (in + conin) )
+    */
+   inline bool output( int64_t conin, int64_t conout, int64_t in, int64_t& out ) {
+      if( conin < 0 || conout < 0 || in < 0 || conin + uint128_t(in) == 0 )
+         return false;
+
+      out = int64_t( uint128_t(in) * uint64_t(conout) / (uint128_t(in) + uint64_t(conin)) );
+      return true;
+   }
+
+} } /// namespace eosiosystem::bancor
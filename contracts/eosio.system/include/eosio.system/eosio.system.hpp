@@ -9,6 +9,7 @@
 #include <eosiolib/time.hpp>
 #include <eosiolib/privileged.hpp>
 #include <eosiolib/singleton.hpp>
+#include <eosiolib/binary_extension.hpp>
 #include <eosio.system/exchange_state.hpp>
 
 #include <string>
@@ -24,6 +25,13 @@
 // be set to 0.
 #define CHANNEL_RAM_AND_NAMEBID_FEES_TO_REX 1
 
+// TO_VOTER_BONUS_RATE macro determines the share of producer vote pay that is paid to the producer's
+// voters instead. It is 0, i.e., no voter bonus, unless set by the build, e.g., for the test build
+// `eosio.system.bonus`.
+#ifndef TO_VOTER_BONUS_RATE
+#define TO_VOTER_BONUS_RATE 0
+#endif
+
 #define TIME_TO_I64(x)   (x.time_since_epoch().count())
 #define I64_TO_TIME(x)   (time_point(microseconds((int64_t)(x))))
 
@@ -109,7 +117,7 @@ namespace eosiosystem {
       double              continuous_rate            = 0.04879; // 5% annual rate
       double              to_producers_rate          = 0.2;
       double              to_bpay_rate               = 0.25; // producer block pay rate with regard to producers pay
-      static constexpr double       to_voter_bonus_rate        = 0; // voter bonus rate with regard to producer voting pay
+      static constexpr double       to_voter_bonus_rate        = TO_VOTER_BONUS_RATE; // voter bonus rate with regard to producer voting pay
       uint32_t            refund_delay_sec           = 3*24*3600;
       const static int64_t      ram_gift_bytes             = 1400;
 
@@ -149,6 +157,51 @@ namespace eosiosystem {
       EOSLIB_SERIALIZE( eosio_global_state3, (last_vpay_state_update)(total_vpay_share_change_rate) )
    };
 
+   /**
+    * Per-block counters updated by `onblock`, kept apart from the global state so that every block
+    * only reads and writes this small row. This row is the source of truth for these fields: the
+    * matching legacy fields of `global` and `global2` are only synced whenever those rows are written
+    * anyway, and may lag behind in between.
+    */
+   struct [[eosio::table("blockstats"), eosio::contract("eosio.system")]] eosio_block_stats {
+      eosio_block_stats() { }
+      block_timestamp   last_block_num;
+      block_timestamp   last_producer_schedule_update;
+      block_timestamp   last_name_close;
+      uint32_t          total_unpaid_blocks = 0; /// all blocks which have been produced but not paid
+      bool              activated = false; ///< latched once total_activated_stake reaches min_activated_stake
+
+      EOSLIB_SERIALIZE( eosio_block_stats, (last_block_num)(last_producer_schedule_update)(last_name_close)
+                        (total_unpaid_blocks)(activated) )
+   };
+
+   /**
+    * The producers elected by the last walk of `prototalvote`, with the vote bounds that tell whether a
+    * vote change can move a producer across the top-N boundary. The schedule is only recomputed when dirty.
+    */
+   struct [[eosio::table("elected"), eosio::contract("eosio.system")]] elected_set {
+      elected_set() { }
+      std::vector<name> producers;     ///< sorted by name
+      double            threshold = 0; ///< lower bound on the votes of every member, 0 while the set is not full
+      double            runner_up = 0; ///< upper bound on the votes of every active non-member
+      bool              dirty = true;
+      capi_checksum256  digest{};      ///< sha256 of the last proposed packed schedule
+
+      EOSLIB_SERIALIZE( elected_set, (producers)(threshold)(runner_up)(dirty)(digest) )
+   };
+
+   /**
+    * The vote weight multiplier of the current week, so that `stake2vote` evaluates `std::pow` once a week
+    * instead of on every vote. The defaults are the exact values for week 0.
+    */
+   struct [[eosio::table("voteweight"), eosio::contract("eosio.system")]] vote_weight_state {
+      vote_weight_state() { }
+      uint32_t          week       = 0; ///< weeks since the block timestamp epoch
+      double            multiplier = 1; ///< std::pow( 2, week / 52. )
+
+      EOSLIB_SERIALIZE( vote_weight_state, (week)(multiplier) )
+   };
+
    struct [[eosio::table, eosio::contract("eosio.system")]] producer_info {
       name                  owner;
       double                total_votes = 0;
@@ -206,7 +259,16 @@ namespace eosiosystem {
       uint32_t            reserved2 = 0;
       eosio::asset        reserved3;
 
+      /**
+       * Compact form of `producers` written while `voteenc` is on: the `prodreg` ids of the voted
+       * producers, in the same order. Read the votes through `system_contract::voted_producers`.
+       */
+      eosio::binary_extension< std::vector<uint16_t> > producer_ids;
+
       uint64_t primary_key()const { return owner.value; }
+      size_t   producers_count()const {
+         return producer_ids.has_value() && !producer_ids.value().empty() ? producer_ids.value().size() : producers.size();
+      }
 
       enum class flags1_fields : uint32_t {
          ram_managed = 1,
@@ -215,7 +277,7 @@ namespace eosiosystem {
       };
 
       // explicit serialization macro is not necessary, used here only to improve compilation time
-      EOSLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3) )
+      EOSLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3)(producer_ids) )
    };
 
    struct [[eosio::table, eosio::contract("eosio.system")]] voter_bonus {
@@ -227,6 +289,101 @@ namespace eosiosystem {
        EOSLIB_SERIALIZE( voter_bonus, (producer)(balance))
    };
 
+   /**
+    * Dense id of a producer, assigned on first use by the compact vote encoding.
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] producer_id_entry {
+      uint64_t id;
+      name     owner;
+
+      uint64_t primary_key()const { return id;          }
+      uint64_t by_owner()const    { return owner.value; }
+
+      EOSLIB_SERIALIZE( producer_id_entry, (id)(owner) )
+   };
+
+   struct [[eosio::table("voteenc"), eosio::contract("eosio.system")]] vote_encoding_config {
+      vote_encoding_config() { }
+      bool     compact = false; ///< voters store producer ids instead of names from their next action on
+
+      EOSLIB_SERIALIZE( vote_encoding_config, (compact) )
+   };
+
+   /**
+    * Cumulative voter bonus paid per unit of vote weight of a producer. Legacy `voterbonus` balances are
+    * folded in by the next reward claim of their producer.
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] producer_bonus_index {
+      name     producer;
+      double   bonus_per_vote = 0;
+
+      uint64_t primary_key()const { return producer.value; }
+
+      EOSLIB_SERIALIZE( producer_bonus_index, (producer)(bonus_per_vote) )
+   };
+
+   /**
+    * The `bonus_per_vote` of a producer as of when a voter started voting for it directly or last folded
+    * its producers, scoped by voter. A missing row stands for 0.
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] voter_bonus_snapshot {
+      name     producer;
+      double   bonus_per_vote = 0;
+
+      uint64_t primary_key()const { return producer.value; }
+
+      EOSLIB_SERIALIZE( voter_bonus_snapshot, (producer)(bonus_per_vote) )
+   };
+
+   /**
+    * Voter bonus bookkeeping of a voter. What it votes for directly has accumulated `bonus_per_vote` plus the
+    * growth of each of its producers since their snapshots. It is owed `weight * (accumulated - snapshot)`,
+    * where accumulated is its own or its proxy's, on top of `owed`. Settled before its weight, producers or
+    * proxy change, so that a claim never pays the current weight for past growth. A missing row stands for
+    * zeros and the voter's current own weight.
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] voter_bonus_account {
+      name     owner;
+      double   bonus_per_vote = 0;
+      double   snapshot = 0;
+      double   weight = 0;
+      int64_t  owed = 0;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      EOSLIB_SERIALIZE( voter_bonus_account, (owner)(bonus_per_vote)(snapshot)(weight)(owed) )
+   };
+
+   /**
+    * A proxy whose proxied_vote_weight changed while lazy proxy propagation was on, and whose pending
+    * weight has not been applied to its producers yet.
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] pending_proxy {
+      name     proxy;
+
+      uint64_t primary_key()const { return proxy.value; }
+
+      EOSLIB_SERIALIZE( pending_proxy, (proxy) )
+   };
+
+   struct [[eosio::table("proxyprop"), eosio::contract("eosio.system")]] proxy_propagation_config {
+      proxy_propagation_config() { }
+      bool     lazy      = false; ///< batch delegator changes on the proxy row instead of propagating them
+      double   threshold = 0;     ///< a pending proxy weight larger than this is still applied right away
+
+      EOSLIB_SERIALIZE( proxy_propagation_config, (lazy)(threshold) )
+   };
+
+   struct [[eosio::table("refundcfg"), eosio::contract("eosio.system")]] refund_queue_config {
+      refund_queue_config() { }
+      bool     enabled       = false; ///< unstakes queue their refund instead of scheduling a deferred refund transaction
+      uint16_t crank_batch   = 50;    ///< matured refunds paid at most by one payrefunds call
+
+      EOSLIB_SERIALIZE( refund_queue_config, (enabled)(crank_batch) )
+   };
+
+   typedef eosio::singleton< "refundcfg"_n, refund_queue_config > refund_queue_singleton;
+
    struct [[eosio::table, eosio::contract("eosio.system")]] privileged_account {
        name account;
 
@@ -236,8 +393,17 @@ namespace eosiosystem {
    };
 
    typedef eosio::multi_index< "voters"_n, voter_info >  voters_table;
+   typedef eosio::multi_index< "pendproxies"_n, pending_proxy > pending_proxy_table;
+   typedef eosio::singleton< "proxyprop"_n, proxy_propagation_config > proxy_propagation_singleton;
 
    typedef eosio::multi_index< "voterbonus"_n, voter_bonus > voter_bonus_table;
+   typedef eosio::multi_index< "prodreg"_n, producer_id_entry,
+                               indexed_by<"byowner"_n, const_mem_fun<producer_id_entry, uint64_t, &producer_id_entry::by_owner>  >
+                             > producer_id_table;
+   typedef eosio::singleton< "voteenc"_n, vote_encoding_config > vote_encoding_singleton;
+   typedef eosio::multi_index< "bonusindex"_n, producer_bonus_index > producer_bonus_table;
+   typedef eosio::multi_index< "bonussnaps"_n, voter_bonus_snapshot > voter_bonus_snapshot_table;
+   typedef eosio::multi_index< "bonusacct"_n, voter_bonus_account > voter_bonus_account_table;
 
    typedef eosio::multi_index< "producers"_n, producer_info,
                                indexed_by<"prototalvote"_n, const_mem_fun<producer_info, double, &producer_info::by_votes>  >
@@ -247,6 +413,9 @@ namespace eosiosystem {
    typedef eosio::singleton< "global"_n, eosio_global_state >   global_state_singleton;
    typedef eosio::singleton< "global2"_n, eosio_global_state2 > global_state2_singleton;
    typedef eosio::singleton< "global3"_n, eosio_global_state3 > global_state3_singleton;
+   typedef eosio::singleton< "blockstats"_n, eosio_block_stats > block_stats_singleton;
+   typedef eosio::singleton< "elected"_n, elected_set >         elected_set_singleton;
+   typedef eosio::singleton< "voteweight"_n, vote_weight_state > vote_weight_singleton;
 
    typedef eosio::multi_index< "privileged"_n, privileged_account >  privileged_account_table;
 
@@ -267,6 +436,30 @@ namespace eosiosystem {
 
    typedef eosio::multi_index< "rexpool"_n, rex_pool > rex_pool_table;
 
+   static constexpr int64_t min_partial_fill_divisor = 10;
+
+   struct [[eosio::table("rexmaint"),eosio::contract("eosio.system")]] rex_maintenance_config {
+      rex_maintenance_config() { }
+      uint32_t user_backlog    = 0;  ///< user actions only process loans and orders while more than this many are due, 0 always does
+      uint16_t user_batch      = 2;  ///< loans and orders of each kind processed by a user action
+      uint16_t crank_batch     = 50; ///< loans and orders of each kind processed at most by one rexmaint call
+      int64_t  reward_per_item = 0;  ///< core token amount paid from the REX pool to the rexmaint caller per processed item, at most a tenth of its payment or proceeds
+      bool     partial_fills   = false; ///< queued sellrex orders are filled with whatever the pool can pay out, if that is at least 1/min_partial_fill_divisor of the order, and stay open for the rest
+
+      EOSLIB_SERIALIZE( rex_maintenance_config, (user_backlog)(user_batch)(crank_batch)(reward_per_item)(partial_fills) )
+   };
+
+   typedef eosio::singleton< "rexmaint"_n, rex_maintenance_config > rex_maintenance_singleton;
+
+   struct [[eosio::table("rexenc"),eosio::contract("eosio.system")]] rex_encoding_config {
+      rex_encoding_config() { }
+      bool     fixed_maturities = false; ///< rex_balance rows move to rex_maturity_buckets when that does not grow them
+
+      EOSLIB_SERIALIZE( rex_encoding_config, (fixed_maturities) )
+   };
+
+   typedef eosio::singleton< "rexenc"_n, rex_encoding_config > rex_encoding_singleton;
+
    struct [[eosio::table,eosio::contract("eosio.system")]] rex_fund {
       uint8_t version = 0;
       name    owner;
@@ -277,6 +470,21 @@ namespace eosiosystem {
 
    typedef eosio::multi_index< "rexfund"_n, rex_fund > rex_fund_table;
 
+   static constexpr uint32_t max_rex_maturities = 5;
+
+   /**
+    * Compact encoding of the REX maturity buckets. REX maturing at the start of day `head_day + i` is
+    * kept in `buckets[i]`. Only the days from the first to the last non-empty bucket are stored, at most
+    * max_rex_maturities of them.
+    */
+   struct rex_maturity_buckets {
+      uint32_t             head_day = 0; /// maturity day of buckets[0]
+      std::vector<int64_t> buckets;      /// consecutive daily buckets
+      int64_t              savings  = 0; /// REX in savings, which never matures
+
+      EOSLIB_SERIALIZE( rex_maturity_buckets, (head_day)(buckets)(savings) )
+   };
+
    struct [[eosio::table,eosio::contract("eosio.system")]] rex_balance {
       uint8_t version = 0;
       name    owner;
@@ -284,6 +492,7 @@ namespace eosiosystem {
       asset   rex_balance; /// the amount of REX owned by owner
       int64_t matured_rex = 0; /// matured REX available for selling
       std::deque<std::pair<time_point_sec, int64_t>> rex_maturities; /// REX daily maturity buckets
+      eosio::binary_extension<rex_maturity_buckets> maturity_buckets; /// replaces rex_maturities once the row is migrated
 
       uint64_t primary_key()const { return owner.value; }
    };
@@ -338,6 +547,36 @@ namespace eosiosystem {
       asset stake_change;
    };
 
+   /**
+    *  One receiver of a buyrammulti batch and the bytes bought for it.
+    */
+   struct ram_purchase {
+      name     receiver;
+      uint32_t bytes;
+
+      EOSLIB_SERIALIZE( ram_purchase, (receiver)(bytes) )
+   };
+
+   /**
+    *  One account created by bulkprov, with the resources and liquid balance it starts with.
+    */
+   struct provision_entry {
+      name        account;
+      public_key  owner_key;
+      public_key  active_key;
+      uint32_t    ram_bytes;
+      asset       net;
+      asset       cpu;
+      asset       liquid;
+
+      EOSLIB_SERIALIZE( provision_entry, (account)(owner_key)(active_key)(ram_bytes)(net)(cpu)(liquid) )
+   };
+
+   struct producer_pay {
+      int64_t block_pay = 0;
+      int64_t vote_pay  = 0;
+   };
+
    class [[eosio::contract("eosio.system")]] system_contract : public native {
 
       private:
@@ -351,6 +590,35 @@ namespace eosiosystem {
          eosio_global_state      _gstate;
          eosio_global_state2     _gstate2;
          eosio_global_state3     _gstate3;
+         // only the changed global singletons are written back on destruction
+         bool                    _gstate_dirty  = false;
+         bool                    _gstate2_dirty = false;
+         bool                    _gstate3_dirty = false;
+         bool                    _globals_loaded = false;
+         block_stats_singleton   _blockstats;
+         std::optional<eosio_block_stats> _gblock; ///< loaded on first use by block_stats()
+         bool                    _gblock_dirty  = false;
+         elected_set_singleton   _electedset;
+         std::optional<elected_set> _elected; ///< loaded on first use by elected()
+         bool                    _elected_dirty = false;
+         /// in-action copy of a producer's rows, written back once by flush_producer_cache()
+         struct producer_cache_entry {
+            producers_table::const_iterator  itr;
+            producers_table2::const_iterator itr2; ///< end() when the producer has no producer_info2 row
+            producer_info                    info;
+            producer_info2                   info2;
+            bool                             dirty  = false;
+            bool                             dirty2 = false;
+         };
+         std::deque<producer_cache_entry> _prodcache;
+         std::optional<vote_encoding_config> _voteenc; ///< loaded on first use by compact_votes()
+         std::vector<name>       _prodnames; ///< owners of the `prodreg` ids decoded so far, indexed by id
+         std::optional<proxy_propagation_config> _proxyprop; ///< loaded on first use by lazy_proxy_propagation()
+         std::optional<rex_maintenance_config> _rexmaint; ///< loaded on first use by rex_maintenance()
+         std::optional<rex_encoding_config> _rexenc; ///< loaded on first use by fixed_rex_maturities()
+         std::optional<refund_queue_config> _refundq; ///< loaded on first use by refund_queue()
+         vote_weight_singleton   _voteweight;
+         std::optional<vote_weight_state> _vweight; ///< loaded on first use by stake2vote()
          rammarket               _rammarket;
          rex_pool_table          _rexpool;
          rex_fund_table          _rexfunds;
@@ -374,6 +642,8 @@ namespace eosiosystem {
          static constexpr symbol rex_symbol     = symbol(symbol_code("REX"), 4);
 
          system_contract( name s, name code, datastream<const char*> ds );
+         /// with `lazy_globals` the global state is only read by `load_globals()`, used by `onblock`
+         system_contract( name s, name code, datastream<const char*> ds, bool lazy_globals );
          ~system_contract();
 
          static symbol get_core_symbol( name system_account = "eosio"_n ) {
@@ -506,6 +776,31 @@ namespace eosiosystem {
          [[eosio::action]]
          void rexexec( const name& user, uint16_t max );
 
+         /**
+          * Sets how much REX maintenance user actions perform, how the rexmaint crank is bounded
+          * and rewarded, and whether queued sellrex orders may be partially filled. The defaults keep
+          * every user action processing 2 loans and orders of each kind, and orders all-or-nothing.
+          */
+         [[eosio::action]]
+         void setrexmaint( uint32_t user_backlog, uint16_t user_batch, uint16_t crank_batch, const asset& reward_per_item,
+                           bool partial_fills );
+
+         /**
+          * Maintenance crank. Processes up to max, and at most crank_batch, expired CPU loans, NET loans
+          * and queued sellrex orders, and pays the caller reward_per_item for each from the REX pool,
+          * capped by a tenth of the loan payment or order proceeds of the item.
+          */
+         [[eosio::action]]
+         void rexmaint( const name& caller, uint16_t max );
+
+         /**
+          * Turns the compact REX maturity bucket encoding on or off. While on, rex_balance rows are
+          * migrated the next time their maturities are processed, unless that would make them larger.
+          * Migrated rows keep the new encoding.
+          */
+         [[eosio::action]]
+         void setrexenc( bool fixed_maturities );
+
          /**
           * Consolidate REX maturity buckets into one that can be sold only 4 days
           * from the end of today.
@@ -536,6 +831,26 @@ namespace eosiosystem {
          [[eosio::action]]
          void closerex( const name& owner );
 
+         /**
+          * Quotes the REX tokens buyrex would issue for amount. Quote actions require no
+          * authorization and write no state; the result is sent as a quoteresult notification
+          * to eosio.rex with the amount paid in and the amount received.
+          */
+         [[eosio::action]]
+         void quoterexbuy( const asset& amount );
+
+         /**
+          * Quotes the core tokens sellrex would pay out for rex.
+          */
+         [[eosio::action]]
+         void quoterexsell( const asset& rex );
+
+         /**
+          * Quotes the tokens a rentcpu or rentnet loan would stake for payment.
+          */
+         [[eosio::action]]
+         void quoterent( const asset& payment );
+
          /**
           *  Decreases the total tokens delegated by from to receiver and/or
           *  frees the memory associated with the delegation if there is nothing
@@ -567,6 +882,31 @@ namespace eosiosystem {
          [[eosio::action]]
          void buyrambytes( name payer, name receiver, uint32_t bytes );
 
+         /**
+          *  Buys RAM for several receivers at once. The RAM supply is updated first, then each entry
+          *  is priced and split as a buyrambytes call in the same order would be after that update,
+          *  i.e. the result matches a batch of buyrambytes in one transaction, except that the first
+          *  buyrambytes of such a batch prices its bytes before the supply update. The payer is billed
+          *  with one transfer and one fee transfer, and the RAM market row is written once.
+          */
+         [[eosio::action]]
+         void buyrammulti( const name& payer, const std::vector<ram_purchase>& purchases );
+
+         /**
+          *  Chain bootstrap. Creates a batch of accounts owned by single keys, funded by the system
+          *  account with self-delegated net and cpu, RAM and a liquid balance. The batch buys its RAM
+          *  from the market in one conversion and stakes with one transfer.
+          */
+         [[eosio::action]]
+         void bulkprov( const std::vector<provision_entry>& accounts );
+
+         /**
+          *  Second half of bulkprov, sent inline once the accounts exist. Sets up the userres,
+          *  delband and voter rows and resource limits of the batch.
+          */
+         [[eosio::action]]
+         void bulkprovres( const std::vector<provision_entry>& accounts );
+
          /**
           *  Reduces quota my bytes and then performs an inline transfer of tokens
           *  to receiver based upon the average purchase price of the original quota.
@@ -574,6 +914,19 @@ namespace eosiosystem {
          [[eosio::action]]
          void sellram( name account, int64_t bytes );
 
+         /**
+          *  Quotes a RAM purchase of quant, an amount of RAM bytes as buyrambytes or of core
+          *  tokens as buyram. See quoterexbuy.
+          */
+         [[eosio::action]]
+         void quoteram( const asset& quant );
+
+         /**
+          *  Quotes the tokens sellram would pay out for bytes. See quoterexbuy.
+          */
+         [[eosio::action]]
+         void quoteramsell( int64_t bytes );
+
          /**
           *  This action is called after the delegation-period to claim all pending
           *  unstaked tokens belonging to owner
@@ -581,6 +934,24 @@ namespace eosiosystem {
          [[eosio::action]]
          void refund( name owner );
 
+         /**
+          *  Switches unstaking between a deferred refund transaction per account and the refund
+          *  queue, and sets how many matured refunds payrefunds pays out at a time. Queued refunds
+          *  are only paid by payrefunds or claimed with refund. Refunds queued while enabled stay
+          *  in the queue after it is disabled.
+          */
+         [[eosio::action]]
+         void setrefundq( bool enabled, uint16_t crank_batch );
+
+         /**
+          *  Refund crank. Pays out up to max, and at most crank_batch, matured refunds from the
+          *  refund queue in maturity order, or only those of owners if it is not empty, which lets
+          *  the crank get past an owner whose account rejects the transfer. Owners may still claim
+          *  theirs with refund.
+          */
+         [[eosio::action]]
+         void payrefunds( const name& caller, uint16_t max, const std::vector<name>& owners );
+
          // functions defined in voting.cpp
 
          [[eosio::action]]
@@ -600,6 +971,27 @@ namespace eosiosystem {
          [[eosio::action]]
          void regproxy( const name proxy, bool isproxy );
 
+         /**
+          *  Turns lazy proxy propagation on or off. While on, a delegator's weight change only updates
+          *  the proxy row, and the proxy's producers are updated once its pending weight exceeds
+          *  `threshold`, when the proxy votes, or by `propproxies`.
+          */
+         [[eosio::action]]
+         void setproxyprop( bool lazy, double threshold );
+
+         /**
+          *  Applies the pending weight of up to `max` proxies to their producers; may be called by anyone.
+          */
+         [[eosio::action]]
+         void propproxies( uint16_t max );
+
+         /**
+          *  Turns the compact vote encoding on or off. Voters are migrated to the chosen encoding the
+          *  next time their vote row is written.
+          */
+         [[eosio::action]]
+         void setvoteenc( bool compact );
+
          [[eosio::action]]
          void setparams( const eosio::blockchain_parameters& params );
 
@@ -610,6 +1002,15 @@ namespace eosiosystem {
          [[eosio::action]]
          void claimbonus( const name owner );
 
+         /**
+          *  Producer pay crank, callable by anyone. Issues the accrued inflation once and pays up to `max`
+          *  of the top voted active producers whose last claim is more than a day old, each with a single
+          *  transfer of the same amount its own claimrewards would have paid at this time. Producers that
+          *  are inactive or already claimed are skipped and do not count against `max`.
+          */
+         [[eosio::action]]
+         void claimall( const name& caller, uint16_t max );
+
          [[eosio::action]]
          void setpriv( name account, uint8_t is_priv );
 
@@ -677,23 +1078,40 @@ namespace eosiosystem {
          using defnetloan_action = eosio::action_wrapper<"defnetloan"_n, &system_contract::defnetloan>;
          using updaterex_action = eosio::action_wrapper<"updaterex"_n, &system_contract::updaterex>;
          using rexexec_action = eosio::action_wrapper<"rexexec"_n, &system_contract::rexexec>;
+         using setrexmaint_action = eosio::action_wrapper<"setrexmaint"_n, &system_contract::setrexmaint>;
+         using rexmaint_action = eosio::action_wrapper<"rexmaint"_n, &system_contract::rexmaint>;
+         using setrexenc_action = eosio::action_wrapper<"setrexenc"_n, &system_contract::setrexenc>;
          using setrex_action = eosio::action_wrapper<"setrex"_n, &system_contract::setrex>;
          using mvtosavings_action = eosio::action_wrapper<"mvtosavings"_n, &system_contract::mvtosavings>;
          using mvfrsavings_action = eosio::action_wrapper<"mvfrsavings"_n, &system_contract::mvfrsavings>;
          using consolidate_action = eosio::action_wrapper<"consolidate"_n, &system_contract::consolidate>;
          using closerex_action = eosio::action_wrapper<"closerex"_n, &system_contract::closerex>;
+         using quoterexbuy_action = eosio::action_wrapper<"quoterexbuy"_n, &system_contract::quoterexbuy>;
+         using quoterexsell_action = eosio::action_wrapper<"quoterexsell"_n, &system_contract::quoterexsell>;
+         using quoterent_action = eosio::action_wrapper<"quoterent"_n, &system_contract::quoterent>;
          using undelegatebw_action = eosio::action_wrapper<"undelegatebw"_n, &system_contract::undelegatebw>;
          using buyram_action = eosio::action_wrapper<"buyram"_n, &system_contract::buyram>;
          using buyrambytes_action = eosio::action_wrapper<"buyrambytes"_n, &system_contract::buyrambytes>;
+         using buyrammulti_action = eosio::action_wrapper<"buyrammulti"_n, &system_contract::buyrammulti>;
+         using bulkprov_action = eosio::action_wrapper<"bulkprov"_n, &system_contract::bulkprov>;
+         using bulkprovres_action = eosio::action_wrapper<"bulkprovres"_n, &system_contract::bulkprovres>;
          using sellram_action = eosio::action_wrapper<"sellram"_n, &system_contract::sellram>;
+         using quoteram_action = eosio::action_wrapper<"quoteram"_n, &system_contract::quoteram>;
+         using quoteramsell_action = eosio::action_wrapper<"quoteramsell"_n, &system_contract::quoteramsell>;
          using refund_action = eosio::action_wrapper<"refund"_n, &system_contract::refund>;
+         using setrefundq_action = eosio::action_wrapper<"setrefundq"_n, &system_contract::setrefundq>;
+         using payrefunds_action = eosio::action_wrapper<"payrefunds"_n, &system_contract::payrefunds>;
          using regproducer_action = eosio::action_wrapper<"regproducer"_n, &system_contract::regproducer>;
          using unregprod_action = eosio::action_wrapper<"unregprod"_n, &system_contract::unregprod>;
          using setram_action = eosio::action_wrapper<"setram"_n, &system_contract::setram>;
          using setramrate_action = eosio::action_wrapper<"setramrate"_n, &system_contract::setramrate>;
          using voteproducer_action = eosio::action_wrapper<"voteproducer"_n, &system_contract::voteproducer>;
          using regproxy_action = eosio::action_wrapper<"regproxy"_n, &system_contract::regproxy>;
+         using setproxyprop_action = eosio::action_wrapper<"setproxyprop"_n, &system_contract::setproxyprop>;
+         using propproxies_action = eosio::action_wrapper<"propproxies"_n, &system_contract::propproxies>;
+         using setvoteenc_action = eosio::action_wrapper<"setvoteenc"_n, &system_contract::setvoteenc>;
          using claimrewards_action = eosio::action_wrapper<"claimrewards"_n, &system_contract::claimrewards>;
+         using claimall_action = eosio::action_wrapper<"claimall"_n, &system_contract::claimall>;
          using rmvproducer_action = eosio::action_wrapper<"rmvproducer"_n, &system_contract::rmvproducer>;
          using updtrevision_action = eosio::action_wrapper<"updtrevision"_n, &system_contract::updtrevision>;
          using bidname_action = eosio::action_wrapper<"bidname"_n, &system_contract::bidname>;
@@ -719,15 +1137,25 @@ namespace eosiosystem {
          static block_timestamp current_block_time();
          symbol core_symbol()const;
          void update_ram_supply();
+         exchange_state pending_rammarket()const;
+         void load_globals();
+         eosio_block_stats& block_stats();
+         void sync_block_stats();
 
          // defined in rex.cpp
-         void runrex( uint16_t max );
+         std::pair<uint32_t, int64_t> runrex( uint16_t max );
+         void run_rex_maintenance();
+         uint32_t rex_backlog( uint32_t limit );
+         const rex_maintenance_config& rex_maintenance();
+         bool fixed_rex_maturities();
          void update_resource_limits( const name& from, const name& receiver, int64_t delta_net, int64_t delta_cpu );
          void check_voting_requirement( const name& owner,
                                         const char* error_msg = "must vote for at least 21 producers or for a proxy before buying REX" )const;
          rex_order_outcome fill_rex_order( const rex_balance_table::const_iterator& bitr, const asset& rex );
+         rex_order_outcome fill_rex_order( rex_pool& pool, const rex_balance_table::const_iterator& bitr, const asset& rex );
          asset update_rex_account( const name& owner, const asset& proceeds, const asset& unstake_quant, bool force_vote_update = false );
          void channel_to_rex( const name& from, const asset& amount );
+         void channel_to_rex( rex_pool& pool, const name& from, const asset& amount );
          void channel_namebid_to_rex( const int64_t highest_bid );
          template <typename T>
          int64_t rent_rex( T& table, const name& from, const name& receiver, const asset& loan_payment, const asset& loan_fund );
@@ -743,15 +1171,20 @@ namespace eosiosystem {
          static time_point_sec get_rex_maturity();
          asset add_to_rex_balance( const name& owner, const asset& payment, const asset& rex_received );
          asset add_to_rex_pool( const asset& payment );
+         static int64_t rex_for_payment( const rex_pool& pool, int64_t payment );
+         static int64_t rex_proceeds( const rex_pool& pool, int64_t rex );
+         void send_quote( const asset& in, const asset& out );
          void process_rex_maturities( const rex_balance_table::const_iterator& bitr );
+         static void add_to_rex_maturity( rex_balance& rb, const time_point_sec& maturity, int64_t rex );
+         static void add_to_rex_maturity_buckets( rex_maturity_buckets& mb, uint32_t day, int64_t rex );
          void consolidate_rex_balance( const rex_balance_table::const_iterator& bitr,
                                        const asset& rex_in_sell_order );
          int64_t read_rex_savings( const rex_balance_table::const_iterator& bitr );
          void put_rex_savings( const rex_balance_table::const_iterator& bitr, int64_t rex );
          void update_rex_stake( const name& voter );
 
-         void add_loan_to_rex_pool( const asset& payment, int64_t rented_tokens, bool new_loan );
-         void remove_loan_from_rex_pool( const rex_loan& loan );
+         static void add_loan_to_rex_pool( rex_pool& pool, const asset& payment, int64_t rented_tokens, bool new_loan );
+         static void remove_loan_from_rex_pool( rex_pool& pool, const rex_loan& loan );
          template <typename Index, typename Iterator>
          int64_t update_renewed_loan( Index& idx, const Iterator& itr, int64_t rented_tokens );
 
@@ -759,14 +1192,43 @@ namespace eosiosystem {
          void changebw( name from, name receiver,
                         asset stake_net_quantity, asset stake_cpu_quantity, bool transfer );
          void update_voting_power( const name& voter, const asset& total_update );
+         void add_ram_quota( const name& receiver, int64_t bytes );
+         const refund_queue_config& refund_queue();
+         uint32_t pay_refunds( uint16_t max, const std::vector<name>& owners );
+         void dequeue_refund( const name& owner );
+
+         // defined in producer_pay.cpp
+         producer_pay fill_pay_buckets( time_point ct, bool fund_buckets );
+         producer_pay claim_producer_pay( const producer_info& prod, time_point ct, const name& payer );
+         void settle_pay_bucket( const name& bucket, int64_t net, const std::string& memo );
 
          // defined in voting.hpp
          void update_elected_producers( block_timestamp timestamp );
+         elected_set& elected();
+         void update_elected_set( const producer_info& prod );
+         void invalidate_elected_set();
+         double stake2vote( int64_t staked );
          void update_votes( const name voter, const name proxy, const std::vector<name>& producers, bool voting );
          void propagate_weight_change( const voter_info& voter );
          double update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
                                                time_point ct,
                                                double shares_rate, bool reset_to_zero = false );
+         static double update_producer_votepay_share( producer_info2& info, time_point ct,
+                                                      double shares_rate, bool reset_to_zero );
+         producer_cache_entry* cached_producer( const name& owner );
+         void flush_producer_cache();
+         bool lazy_proxy_propagation();
+         bool defer_proxy_propagation( const voter_info& proxy );
+         bool compact_votes();
+         uint16_t producer_id( const name& owner );
+         std::vector<name> voted_producers( const voter_info& voter );
+         void set_voted_producers( voter_info& voter, const std::vector<name>& producers );
+         double accumulated_bonus_per_vote( const name& owner, const std::vector<name>& producers );
+         double voter_bonus_per_vote( const voter_info& voter );
+         double fold_voter_bonus( const voter_info& voter, const std::vector<name>& old_producers,
+                                  const std::vector<name>& new_producers );
+         int64_t settle_voter_bonus( const voter_info& voter, double bonus_per_vote, double next_bonus_per_vote,
+                                     double next_weight, bool claim = false );
          double update_total_votepay_share( time_point ct,
                                             double additional_shares_delta = 0.0, double shares_rate_delta = 0.0 );
 
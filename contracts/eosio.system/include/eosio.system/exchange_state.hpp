@@ -1,6 +1,15 @@
 #pragma once
 
 #include <eosiolib/asset.hpp>
+#include <eosio.system/bancor_math.hpp>
+
+// FIXED_POINT_BANCOR macro determines whether the RAM market and REX price trades with the
+// 128-bit integer math of bancor_math.hpp instead of double precision floating point. Both
+// agree to within one token unit, but individual trades may round differently, so it is 0
+// unless the build sets it to 1, i.e., `cmake -DFIXED_POINT_BANCOR=ON`.
+#ifndef FIXED_POINT_BANCOR
+#define FIXED_POINT_BANCOR 0
+#endif
 
 namespace eosiosystem {
    using eosio::asset;
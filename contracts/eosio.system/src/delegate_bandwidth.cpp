@@ -73,6 +73,21 @@ namespace eosiosystem {
       EOSLIB_SERIALIZE( refund_request, (owner)(request_time)(net_amount)(cpu_amount) )
    };
 
+   /**
+    *  Refund queue entry, scoped to the system account. Points at the owner's refund_request
+    *  and orders it by the time the refund matures.
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] refund_queue_entry {
+      name            owner;
+      time_point_sec  maturity;
+
+      uint64_t  primary_key()const { return owner.value; }
+      uint64_t  by_maturity()const { return maturity.utc_seconds; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( refund_queue_entry, (owner)(maturity) )
+   };
+
    /**
     *  These tables are designed to be constructed in the scope of the relevant user, this
     *  facilitates simpler API for per-user queries
@@ -80,6 +95,9 @@ namespace eosiosystem {
    typedef eosio::multi_index< "userres"_n, user_resources >      user_resources_table;
    typedef eosio::multi_index< "delband"_n, delegated_bandwidth > del_bandwidth_table;
    typedef eosio::multi_index< "refunds"_n, refund_request >      refunds_table;
+   typedef eosio::multi_index< "refundqueue"_n, refund_queue_entry,
+                               indexed_by<"bymaturity"_n, const_mem_fun<refund_queue_entry, uint64_t, &refund_queue_entry::by_maturity>>
+                             > refund_queue_table;
 
 
 
@@ -146,7 +164,78 @@ namespace eosiosystem {
 
       _gstate.total_ram_bytes_reserved += uint64_t(bytes_out);
       _gstate.total_ram_stake          += quant_after_fee.amount;
+      _gstate_dirty = true;
 
+      add_ram_quota( receiver, bytes_out );
+   }
+
+   /**
+    *  Each purchase is priced like buyrambytes followed by buyram, on an in-memory copy of the
+    *  RAM market that carries the price movement of the previous entries, so every receiver gets
+    *  the bytes the sequential calls would give once the RAM supply is updated. Fees are rounded up
+    *  per entry as in buyram.
+    */
+   void system_contract::buyrammulti( const name& payer, const std::vector<ram_purchase>& purchases )
+   {
+      require_auth( payer );
+      check( !purchases.empty(), "no ram purchases" );
+      update_ram_supply();
+
+      const auto& market = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
+      const symbol core_sym = market.quote.balance.symbol;
+      exchange_state es = market;
+
+      asset total_after_fee( 0, core_sym );
+      asset total_fee( 0, core_sym );
+      std::vector<int64_t> bytes_out;
+      bytes_out.reserve( purchases.size() );
+      for( const auto& p : purchases ) {
+         auto tmp = es;
+         auto quant = tmp.convert( asset(p.bytes, ram_symbol), core_sym );
+         check( quant.amount > 0, "must purchase a positive amount" );
+
+         auto fee = quant;
+         fee.amount = ( fee.amount + 199 ) / 200; /// .5% fee (round up)
+         auto quant_after_fee = quant;
+         quant_after_fee.amount -= fee.amount;
+
+         const int64_t out = es.convert( quant_after_fee, ram_symbol ).amount;
+         check( out > 0, "must reserve a positive amount" );
+
+         bytes_out.push_back( out );
+         total_after_fee += quant_after_fee;
+         total_fee       += fee;
+         _gstate.total_ram_bytes_reserved += uint64_t(out);
+      }
+      _gstate.total_ram_stake += total_after_fee.amount;
+      _gstate_dirty = true;
+
+      _rammarket.modify( market, same_payer, [&]( auto& m ) {
+         m = es;
+      });
+
+      INLINE_ACTION_SENDER(eosio::token, transfer)(
+         token_account, { {payer, active_permission}, {ram_account, active_permission} },
+         { payer, ram_account, total_after_fee, std::string("buy ram") }
+      );
+
+      INLINE_ACTION_SENDER(eosio::token, transfer)(
+         token_account, { {payer, active_permission} },
+         { payer, ramfee_account, total_fee, std::string("ram fee") }
+      );
+      channel_to_rex( ramfee_account, total_fee );
+
+      for( size_t i = 0; i < purchases.size(); ++i ) {
+         add_ram_quota( purchases[i].receiver, bytes_out[i] );
+      }
+   }
+
+   /**
+    *  Credits bytes bought by buyram or buyrammulti to the receiver's quota and, unless the
+    *  receiver's RAM is managed separately, raises its resource limits accordingly.
+    */
+   void system_contract::add_ram_quota( const name& receiver, int64_t bytes )
+   {
       user_resources_table  userres( _self, receiver.value );
       auto res_itr = userres.find( receiver.value );
       if( res_itr ==  userres.end() ) {
@@ -154,11 +243,11 @@ namespace eosiosystem {
                res.owner = receiver;
                res.net_weight = asset( 0, core_symbol() );
                res.cpu_weight = asset( 0, core_symbol() );
-               res.ram_bytes = bytes_out;
+               res.ram_bytes = bytes;
             });
       } else {
          userres.modify( res_itr, receiver, [&]( auto& res ) {
-               res.ram_bytes += bytes_out;
+               res.ram_bytes += bytes;
             });
       }
 
@@ -170,6 +259,129 @@ namespace eosiosystem {
       }
    }
 
+   /**
+    *  Accounts cannot be created from within an action, so the batch sends one inline newaccount
+    *  per entry, which also runs native::newaccount for the userres row, and then bulkprovres to
+    *  fill in the resources once all of them exist.
+    */
+   void system_contract::bulkprov( const std::vector<provision_entry>& accounts )
+   {
+      require_auth( _self );
+      check( !accounts.empty(), "no accounts to provision" );
+
+      const symbol core_sym = core_symbol();
+      for( const auto& a : accounts ) {
+         check( a.net.symbol == core_sym && a.cpu.symbol == core_sym && a.liquid.symbol == core_sym,
+                "must use core token" );
+         check( 0 <= a.net.amount && 0 <= a.cpu.amount && 0 <= a.liquid.amount,
+                "must provision a non-negative amount" );
+
+         authority owner;
+         owner.threshold = 1;
+         owner.keys.push_back( key_weight{ a.owner_key, 1 } );
+         authority active;
+         active.threshold = 1;
+         active.keys.push_back( key_weight{ a.active_key, 1 } );
+
+         eosio::action( permission_level{ _self, active_permission }, _self, "newaccount"_n,
+                        std::make_tuple( _self, a.account, owner, active ) ).send();
+      }
+
+      bulkprovres_action resources{ _self, { _self, active_permission } };
+      resources.send( accounts );
+   }
+
+   /**
+    *  The RAM of each entry is priced like buyrambytes without the fee, on an in-memory copy of the
+    *  RAM market as in buyrammulti, and each account is credited the bytes that conversion gives.
+    *  The stake and RAM cost are each paid with one transfer from the system account.
+    */
+   void system_contract::bulkprovres( const std::vector<provision_entry>& accounts )
+   {
+      require_auth( _self );
+      update_ram_supply();
+
+      const symbol core_sym = core_symbol();
+      asset   total_stake( 0, core_sym );
+      bool    buys_ram = false;
+      for( const auto& a : accounts ) {
+         total_stake += a.net + a.cpu;
+         buys_ram    |= 0 < a.ram_bytes;
+      }
+
+      std::vector<int64_t> bytes_out( accounts.size(), 0 );
+      if( buys_ram ) {
+         const auto& market = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
+         exchange_state es = market;
+
+         asset ram_cost( 0, core_sym );
+         for( size_t i = 0; i < accounts.size(); ++i ) {
+            if( accounts[i].ram_bytes == 0 ) {
+               continue;
+            }
+            auto tmp = es;
+            const asset quant = tmp.convert( asset(accounts[i].ram_bytes, ram_symbol), core_sym );
+            bytes_out[i] = es.convert( quant, ram_symbol ).amount;
+            check( bytes_out[i] > 0, "must reserve a positive amount" );
+
+            ram_cost += quant;
+            _gstate.total_ram_bytes_reserved += uint64_t(bytes_out[i]);
+         }
+         _rammarket.modify( market, same_payer, [&]( auto& m ) {
+            m = es;
+         });
+
+         _gstate.total_ram_stake += ram_cost.amount;
+         _gstate_dirty = true;
+
+         if( 0 < ram_cost.amount ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {_self, active_permission} },
+               { _self, ram_account, ram_cost, std::string("buy ram") }
+            );
+         }
+      }
+
+      if( 0 < total_stake.amount ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {_self, active_permission} },
+            { _self, stake_account, total_stake, std::string("stake bandwidth") }
+         );
+      }
+
+      for( size_t i = 0; i < accounts.size(); ++i ) {
+         const auto& a = accounts[i];
+         user_resources_table userres( _self, a.account.value );
+         auto res_itr = userres.require_find( a.account.value, "account was not created" );
+         userres.modify( res_itr, same_payer, [&]( auto& res ) {
+            res.net_weight += a.net;
+            res.cpu_weight += a.cpu;
+            res.ram_bytes  += bytes_out[i];
+         });
+
+         if( 0 < a.net.amount || 0 < a.cpu.amount ) {
+            del_bandwidth_table del_tbl( _self, a.account.value );
+            del_tbl.emplace( a.account, [&]( auto& dbo ) {
+               dbo.from       = a.account;
+               dbo.to         = a.account;
+               dbo.net_weight = a.net;
+               dbo.cpu_weight = a.cpu;
+            });
+            update_voting_power( a.account, a.net + a.cpu );
+         }
+
+         set_resource_limits( a.account.value, res_itr->ram_bytes + _gstate.ram_gift_bytes,
+                              res_itr->net_weight.amount, res_itr->cpu_weight.amount );
+
+         if( 0 < a.liquid.amount ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {_self, active_permission} },
+               { _self, a.account, a.liquid, std::string("provisioned balance") }
+            );
+         }
+      }
+   }
+
   /**
     *  The system contract now buys and sells RAM allocations at prevailing market prices.
     *  This may result in traders buying RAM today in anticipation of potential shortages
@@ -198,6 +410,7 @@ namespace eosiosystem {
 
       _gstate.total_ram_bytes_reserved -= static_cast<decltype(_gstate.total_ram_bytes_reserved)>(bytes); // bytes > 0 is asserted above
       _gstate.total_ram_stake          -= tokens_out.amount;
+      _gstate_dirty = true;
 
       //// this shouldn't happen, but just in case it does we should prevent it
       check( _gstate.total_ram_stake >= 0, "error, attempt to unstake more tokens than previously staked" );
@@ -229,6 +442,49 @@ namespace eosiosystem {
       }
    }
 
+   /**
+    *  Quotes a RAM purchase without buying. A RAM amount is priced as buyrambytes prices it and
+    *  a core token amount is spent as buyram spends it; the quote reports the tokens paid,
+    *  including the fee, and the bytes received.
+    */
+   void system_contract::quoteram( const asset& quant ) {
+      check( quant.amount > 0, "must purchase a positive amount" );
+
+      asset cost = quant;
+      if( quant.symbol == ram_symbol ) {
+         // buyrambytes prices the bytes before buyram updates the RAM supply
+         auto tmp = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
+         cost = tmp.convert( quant, core_symbol() );
+         check( cost.amount > 0, "must purchase a positive amount" );
+      } else {
+         check( quant.symbol == core_symbol(), "must buy ram with core token" );
+      }
+
+      auto quant_after_fee = cost;
+      quant_after_fee.amount -= ( cost.amount + 199 ) / 200; /// .5% fee (round up)
+
+      auto market = pending_rammarket();
+      const asset bytes_out = market.convert( quant_after_fee, ram_symbol );
+      check( bytes_out.amount > 0, "must reserve a positive amount" );
+
+      send_quote( cost, bytes_out );
+   }
+
+   /**
+    *  Quotes a RAM sale without selling; the quote reports the bytes sold and the tokens
+    *  received after the fee.
+    */
+   void system_contract::quoteramsell( int64_t bytes ) {
+      check( bytes > 0, "cannot sell negative byte" );
+
+      auto market = pending_rammarket();
+      asset tokens_out = market.convert( asset(bytes, ram_symbol), core_symbol() );
+      check( tokens_out.amount > 1, "token amount received from selling ram is too low" );
+
+      tokens_out.amount -= ( tokens_out.amount + 199 ) / 200; /// .5% fee (round up)
+      send_quote( asset(bytes, ram_symbol), tokens_out );
+   }
+
    void validate_b1_vesting( int64_t stake ) {
       const int64_t base_time = 1527811200; /// 2018-06-01
       const int64_t max_claimable = 100'000'000'0000ll;
@@ -391,7 +647,22 @@ namespace eosiosystem {
             } // else stake increase requested with no existing row in refunds_tbl -> nothing to do with refunds_tbl
          } /// end if is_delegating_to_self || is_undelegating
 
-         if ( need_deferred_trx ) {
+         if ( need_deferred_trx && refund_queue().enabled ) {
+            const time_point_sec maturity = refunds_tbl.get( from.value ).request_time + _gstate.refund_delay_sec;
+            refund_queue_table queue( _self, _self.value );
+            auto qitr = queue.find( from.value );
+            if ( qitr == queue.end() ) {
+               queue.emplace( from, [&]( auto& q ) {
+                  q.owner    = from;
+                  q.maturity = maturity;
+               });
+            } else if ( qitr->maturity != maturity ) {
+               queue.modify( qitr, same_payer, [&]( auto& q ) {
+                  q.maturity = maturity;
+               });
+            }
+            cancel_deferred( from.value ); // refund scheduled before the queue was enabled
+         } else if ( need_deferred_trx ) {
             eosio::transaction out;
             out.actions.emplace_back( permission_level{from, active_permission},
                                       _self, "refund"_n,
@@ -402,6 +673,9 @@ namespace eosiosystem {
             out.send( from.value, from, true );
          } else {
             cancel_deferred( from.value );
+            if ( refund_queue().enabled ) {
+               dequeue_refund( from );
+            }
          }
 
          auto transfer_amount = net_balance + cpu_balance;
@@ -439,8 +713,8 @@ namespace eosiosystem {
          validate_b1_vesting( voter_itr->staked );
       }
 
-      if( voter_itr->producers.size() || voter_itr->proxy ) {
-         update_votes( voter, voter_itr->proxy, voter_itr->producers, false );
+      if( voter_itr->producers_count() || voter_itr->proxy ) {
+         update_votes( voter, voter_itr->proxy, voted_producers( *voter_itr ), false );
       }
    }
 
@@ -486,6 +760,108 @@ namespace eosiosystem {
       );
 
       refunds_tbl.erase( req );
+      dequeue_refund( owner );
+   }
+
+   void system_contract::setrefundq( bool enabled, uint16_t crank_batch )
+   {
+      require_auth( _self );
+
+      check( 0 < crank_batch, "crank_batch must be positive" );
+
+      refund_queue_config config;
+      config.enabled       = enabled;
+      config.crank_batch   = crank_batch;
+      refund_queue_singleton( _self, _self.value ).set( config, _self );
+      _refundq = config;
+   }
+
+   void system_contract::payrefunds( const name& caller, uint16_t max, const std::vector<name>& owners )
+   {
+      require_auth( caller );
+
+      check( 0 < max, "max must be positive" );
+      check( 0 < pay_refunds( std::min( max, refund_queue().crank_batch ), owners ), "no matured refunds" );
+   }
+
+   const refund_queue_config& system_contract::refund_queue()
+   {
+      if ( !_refundq ) {
+         _refundq = refund_queue_singleton( _self, _self.value ).get_or_default();
+      }
+      return *_refundq;
+   }
+
+   /**
+    *  Pays out matured refunds of the given owners, or from the front of the refund queue if owners
+    *  is empty. Entries whose refund was already claimed are dropped and entries that are not due
+    *  under the current refund_delay_sec are moved back; both count against max so the work stays
+    *  bounded.
+    *
+    *  @return number of queue entries paid, dropped or moved back
+    */
+   uint32_t system_contract::pay_refunds( uint16_t max, const std::vector<name>& owners )
+   {
+      refund_queue_table queue( _self, _self.value );
+      const time_point_sec now = current_time_point_sec();
+
+      uint32_t handled = 0;
+      auto pay = [&]( const refund_queue_table::const_iterator& itr ) {
+         ++handled;
+         const name owner = itr->owner;
+         refunds_table refunds_tbl( _self, owner.value );
+         auto req = refunds_tbl.find( owner.value );
+         if ( req == refunds_tbl.end() ) {
+            queue.erase( itr );
+            return;
+         }
+
+         const time_point_sec maturity = req->request_time + _gstate.refund_delay_sec;
+         if ( now < maturity ) {
+            queue.modify( itr, same_payer, [&]( auto& q ) {
+               q.maturity = maturity;
+            });
+            return;
+         }
+
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {stake_account, active_permission} },
+            { stake_account, owner, req->net_amount + req->cpu_amount, std::string("unstake") }
+         );
+         refunds_tbl.erase( req );
+         queue.erase( itr );
+      };
+
+      if ( owners.empty() ) {
+         auto idx = queue.get_index<"bymaturity"_n>();
+         while ( handled < max ) {
+            auto itr = idx.begin();
+            if ( itr == idx.end() || now < itr->maturity ) {
+               break;
+            }
+            pay( queue.iterator_to( *itr ) );
+         }
+      } else {
+         for ( const auto& owner : owners ) {
+            if ( max <= handled ) {
+               break;
+            }
+            auto itr = queue.find( owner.value );
+            if ( itr != queue.end() && itr->maturity <= now ) {
+               pay( itr );
+            }
+         }
+      }
+      return handled;
+   }
+
+   void system_contract::dequeue_refund( const name& owner )
+   {
+      refund_queue_table queue( _self, _self.value );
+      auto itr = queue.find( owner.value );
+      if ( itr != queue.end() ) {
+         queue.erase( itr );
+      }
    }
 
 
@@ -11,6 +11,9 @@
 namespace eosiosystem {
 
    system_contract::system_contract( name s, name code, datastream<const char*> ds )
+   :system_contract( s, code, ds, false ) {}
+
+   system_contract::system_contract( name s, name code, datastream<const char*> ds, bool lazy_globals )
    :native(s,code,ds),
     _voters(_self, _self.value),
     _voterbonus(_self, _self.value),
@@ -19,6 +22,9 @@ namespace eosiosystem {
     _global(_self, _self.value),
     _global2(_self, _self.value),
     _global3(_self, _self.value),
+    _blockstats(_self, _self.value),
+    _electedset(_self, _self.value),
+    _voteweight(_self, _self.value),
     _rammarket(_self, _self.value),
     _rexpool(_self, _self.value),
     _rexfunds(_self, _self.value),
@@ -26,9 +32,48 @@ namespace eosiosystem {
     _rexorders(_self, _self.value)
    {
       //print( "construct system\n" );
-      _gstate  = _global.exists() ? _global.get() : get_default_parameters();
-      _gstate2 = _global2.exists() ? _global2.get() : eosio_global_state2{};
-      _gstate3 = _global3.exists() ? _global3.get() : eosio_global_state3{};
+      if( !lazy_globals )
+         load_globals();
+   }
+
+   void system_contract::load_globals() {
+      if( _globals_loaded )
+         return;
+      _globals_loaded = true;
+      _gstate_dirty  = !_global.exists();
+      _gstate2_dirty = !_global2.exists();
+      _gstate3_dirty = !_global3.exists();
+      _gstate  = !_gstate_dirty ? _global.get() : get_default_parameters();
+      _gstate2 = !_gstate2_dirty ? _global2.get() : eosio_global_state2{};
+      _gstate3 = !_gstate3_dirty ? _global3.get() : eosio_global_state3{};
+   }
+
+   eosio_block_stats& system_contract::block_stats() {
+      if( !_gblock ) {
+         if( _blockstats.exists() ) {
+            _gblock = _blockstats.get();
+         } else {
+            /// first use after upgrade, seed the counters from the legacy globals
+            load_globals();
+            _gblock.emplace();
+            _gblock->last_block_num                = _gstate2.last_block_num;
+            _gblock->last_producer_schedule_update = _gstate.last_producer_schedule_update;
+            _gblock->last_name_close               = _gstate.last_name_close;
+            _gblock->total_unpaid_blocks           = _gstate.total_unpaid_blocks;
+            _gblock_dirty = true;
+         }
+      }
+      return *_gblock;
+   }
+
+   void system_contract::sync_block_stats() {
+      if( !_gblock && !_blockstats.exists() )
+         return;
+      const auto& bs = block_stats();
+      _gstate.last_producer_schedule_update = bs.last_producer_schedule_update;
+      _gstate.last_name_close               = bs.last_name_close;
+      _gstate.total_unpaid_blocks           = bs.total_unpaid_blocks;
+      _gstate2.last_block_num               = bs.last_block_num;
    }
 
    eosio_global_state system_contract::get_default_parameters() {
@@ -58,9 +103,15 @@ namespace eosiosystem {
    }
 
    system_contract::~system_contract() {
-      _global.set( _gstate, _self );
-      _global2.set( _gstate2, _self );
-      _global3.set( _gstate3, _self );
+      if( _gblock_dirty ) _blockstats.set( *_gblock, _self );
+      if( _elected_dirty ) _electedset.set( *_elected, _self );
+      if( !_globals_loaded )
+         return;
+      /// the legacy per-block fields are brought up to date whenever their rows are written anyway
+      if( _gstate_dirty || _gstate2_dirty ) sync_block_stats();
+      if( _gstate_dirty )  _global.set( _gstate, _self );
+      if( _gstate2_dirty ) _global2.set( _gstate2, _self );
+      if( _gstate3_dirty ) _global3.set( _gstate3, _self );
    }
 
    void system_contract::setram( uint64_t max_ram_size ) {
@@ -81,6 +132,7 @@ namespace eosiosystem {
       });
 
       _gstate.max_ram_size = max_ram_size;
+      _gstate_dirty = true;
    }
 
    void system_contract::update_ram_supply() {
@@ -99,6 +151,20 @@ namespace eosiosystem {
          m.base.balance.amount += new_ram;
       });
       _gstate2.last_ram_increase = cbt;
+      _gstate_dirty = _gstate2_dirty = true;
+   }
+
+   /**
+    *  Returns the RAM market as update_ram_supply would leave it in this block, without
+    *  writing it, for the read-only quote actions.
+    */
+   exchange_state system_contract::pending_rammarket()const {
+      auto market = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
+      auto cbt = current_block_time();
+      if( cbt > _gstate2.last_ram_increase ) {
+         market.base.balance.amount += (cbt.slot - _gstate2.last_ram_increase.slot)*_gstate2.new_ram_per_block;
+      }
+      return market;
    }
 
    /**
@@ -113,11 +179,13 @@ namespace eosiosystem {
 
       update_ram_supply();
       _gstate2.new_ram_per_block = bytes_per_block;
+      _gstate2_dirty = true;
    }
 
    void system_contract::setparams( const eosio::blockchain_parameters& params ) {
       require_auth( _self );
       (eosio::blockchain_parameters&)(_gstate) = params;
+      _gstate_dirty = true;
       check( 3 <= _gstate.max_authority_depth, "max_authority_depth should be at least 3" );
       set_blockchain_parameters( params );
    }
@@ -294,6 +362,7 @@ namespace eosiosystem {
       _producers.modify( prod, same_payer, [&](auto& p) {
             p.deactivate();
          });
+      invalidate_elected_set();
    }
 
    void system_contract::updtrevision( uint8_t revision ) {
@@ -303,6 +372,7 @@ namespace eosiosystem {
       check( revision <= 1, // set upper bound to greatest revision supported in the code
                     "specified revision is not yet supported by the code" );
       _gstate2.revision = revision;
+      _gstate2_dirty = true;
    }
 
    void system_contract::bidname( name bidder, name newname, asset bid ) {
@@ -479,6 +549,7 @@ namespace eosiosystem {
       }
 
       check( _gstate.total_activated_stake < _gstate.min_activated_stake, "minimum activated stake has reached" );
+      _gstate_dirty = true;
 
       if (name == "max_producer_schedule_size") {
          auto sched_size = std::stoi(value);
@@ -487,6 +558,7 @@ namespace eosiosystem {
          check( sched_size % 2 == 1, "producers number must be odd" );
 
          _gstate.max_producer_schedule_size = static_cast<uint8_t>(sched_size);
+         invalidate_elected_set();
       } else if (name == "min_pervote_daily_pay") {
          auto min_vpay = std::stoll(value);
 
@@ -576,20 +648,47 @@ namespace eosiosystem {
 } /// eosio.system
 
 
-EOSIO_DISPATCH( eosiosystem::system_contract,
-     // native.hpp (newaccount definition is actually in eosio.system.cpp)
-     (newaccount)(updateauth)(deleteauth)(linkauth)(unlinkauth)(canceldelay)(onerror)(setabi)
-     // eosio.system.cpp
-     (init)(setram)(setramrate)(setparams)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)
-     (rmvproducer)(updtrevision)(bidname)(bidrefund)
-     (setglobal)(setmrs)(updtbwlist)(addprvlgd)(rmvprvlgd)
-     // rex.cpp
-     (deposit)(withdraw)(buyrex)(unstaketorex)(sellrex)(cnclrexorder)(rentcpu)(rentnet)(fundcpuloan)(fundnetloan)
-     (defcpuloan)(defnetloan)(updaterex)(consolidate)(mvtosavings)(mvfrsavings)(setrex)(rexexec)(closerex)
-     // delegate_bandwidth.cpp
-     (buyrambytes)(buyram)(sellram)(delegatebw)(undelegatebw)(refund)
-     // voting.cpp
-     (regproducer)(unregprod)(voteproducer)(regproxy)
-     // producer_pay.cpp
-     (onblock)(claimrewards)(claimbonus)
-)
+extern "C" {
+   void apply( uint64_t receiver, uint64_t code, uint64_t action ) {
+      if( code != receiver )
+         return;
+
+      if( action == "onblock"_n.value ) {
+         /// runs on every block, so the global state is left unread unless the block needs it
+         constexpr size_t max_stack_buffer_size = 512;
+         size_t size = action_data_size();
+         void* buffer = max_stack_buffer_size < size ? malloc(size) : alloca(size);
+         read_action_data( buffer, size );
+         {
+            eosiosystem::system_contract thiscontract( name(receiver), name(code), eosio::datastream<const char*>((char*)buffer, size), true );
+            thiscontract.onblock( eosio::ignore<eosiosystem::block_header>{} );
+         }
+         if ( max_stack_buffer_size < size ) {
+            free(buffer);
+         }
+         return;
+      }
+
+      switch( action ) {
+         EOSIO_DISPATCH_HELPER( eosiosystem::system_contract,
+            // native.hpp (newaccount definition is actually in eosio.system.cpp)
+            (newaccount)(updateauth)(deleteauth)(linkauth)(unlinkauth)(canceldelay)(onerror)(setabi)
+            // eosio.system.cpp
+            (init)(setram)(setramrate)(setparams)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)
+            (rmvproducer)(updtrevision)(bidname)(bidrefund)
+            (setglobal)(setmrs)(updtbwlist)(addprvlgd)(rmvprvlgd)
+            // rex.cpp
+            (deposit)(withdraw)(buyrex)(unstaketorex)(sellrex)(cnclrexorder)(rentcpu)(rentnet)(fundcpuloan)(fundnetloan)
+            (defcpuloan)(defnetloan)(updaterex)(consolidate)(mvtosavings)(mvfrsavings)(setrex)(rexexec)(setrexmaint)(rexmaint)(setrexenc)(closerex)
+            (quoterexbuy)(quoterexsell)(quoterent)
+            // delegate_bandwidth.cpp
+            (buyrambytes)(buyram)(buyrammulti)(bulkprov)(bulkprovres)(sellram)(quoteram)(quoteramsell)(delegatebw)(undelegatebw)(refund)(setrefundq)(payrefunds)
+            // voting.cpp
+            (regproducer)(unregprod)(voteproducer)(regproxy)(setproxyprop)(propproxies)(setvoteenc)
+            // producer_pay.cpp
+            (claimrewards)(claimbonus)(claimall)
+         )
+      }
+      /* does not allow destructor of thiscontract to run: eosio_exit(0); */
+   }
+}
@@ -26,18 +26,27 @@ namespace eosiosystem {
       name producer;
       _ds >> timestamp >> producer;
 
-      // _gstate2.last_block_num is not used anywhere in the system contract code anymore.
+      auto& bs = block_stats();
+
+      // last_block_num is not used anywhere in the system contract code anymore.
       // Although this field is deprecated, we will continue updating it for now until the last_block_num field
       // is eventually completely removed, at which point this line can be removed.
-      _gstate2.last_block_num = timestamp;
+      bs.last_block_num = timestamp;
+      _gblock_dirty = true;
 
       /** until activated stake crosses this threshold no new rewards are paid */
-      if( _gstate.total_activated_stake < _gstate.min_activated_stake )
-         return;
-
-      if( _gstate.last_pervote_bucket_fill == TIME_TO_I64(time_point()) )  /// start the presses
-         _gstate.last_pervote_bucket_fill = TIME_TO_I64(current_time_point());
-
+      if( !bs.activated ) {
+         /// total_activated_stake never decreases and min_activated_stake is frozen once reached, so this latches
+         load_globals();
+         if( _gstate.total_activated_stake < _gstate.min_activated_stake )
+            return;
+         bs.activated = true;
+
+         if( _gstate.last_pervote_bucket_fill == TIME_TO_I64(time_point()) ) { /// start the presses
+            _gstate.last_pervote_bucket_fill = TIME_TO_I64(current_time_point());
+            _gstate_dirty = true;
+         }
+      }
 
       /**
        * At startup the initial producer may not be one that is registered / elected
@@ -45,17 +54,18 @@ namespace eosiosystem {
        */
       auto prod = _producers.find( producer.value );
       if ( prod != _producers.end() ) {
-         _gstate.total_unpaid_blocks++;
+         bs.total_unpaid_blocks++;
          _producers.modify( prod, same_payer, [&](auto& p ) {
                p.unpaid_blocks++;
          });
       }
 
       /// only update block producers once every minute, block_timestamp is in half seconds
-      if( timestamp.slot - _gstate.last_producer_schedule_update.slot > 120 ) {
+      if( timestamp.slot - bs.last_producer_schedule_update.slot > 120 ) {
+         load_globals();
          update_elected_producers( timestamp );
 
-         if( (timestamp.slot - _gstate.last_name_close.slot) > blocks_per_day ) {
+         if( (timestamp.slot - bs.last_name_close.slot) > blocks_per_day ) {
             name_bid_table bids(_self, _self.value);
             auto idx = bids.get_index<"highbid"_n>();
             auto highest = idx.lower_bound( std::numeric_limits<uint64_t>::max()/2 );
@@ -65,7 +75,7 @@ namespace eosiosystem {
                 _gstate.thresh_activated_stake_time > TIME_TO_I64(time_point()) &&
                 (current_time_point() - I64_TO_TIME(_gstate.thresh_activated_stake_time)) > microseconds(14 * _gstate.useconds_per_day)
             ) {
-               _gstate.last_name_close = timestamp;
+               bs.last_name_close = timestamp;
                channel_namebid_to_rex( highest->high_bid );
                idx.modify( highest, same_payer, [&]( auto& b ){
                   b.high_bid = -b.high_bid;
@@ -76,18 +86,14 @@ namespace eosiosystem {
    }
 
    using namespace eosio;
-   void system_contract::claimrewards( const name owner ) {
-      require_auth( owner );
-
-      const auto& prod = _producers.get( owner.value );
-      check( prod.active(), "producer does not have an active key" );
-
-      check( _gstate.total_activated_stake >= _gstate.min_activated_stake,
-                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
-
-      const auto ct = current_time_point();
 
-      check( ct - prod.last_claim_time > microseconds(_gstate.useconds_per_day), "already claimed rewards within past day" );
+   /**
+    *  Issues the inflation accrued since the last bucket fill, sends the savings share to eosio.saving and
+    *  adds the producer shares to the pay buckets. With `fund_buckets` the bucket shares are transferred to
+    *  eosio.bpay and eosio.vpay, otherwise they stay with the system account for the caller to settle.
+    */
+   producer_pay system_contract::fill_pay_buckets( time_point ct, bool fund_buckets ) {
+      producer_pay funded;
 
       const asset token_supply   = eosio::token::get_supply(token_account, core_symbol().code() );
       const auto usecs_since_last_fill = (ct - I64_TO_TIME(_gstate.last_pervote_bucket_fill)).count();
@@ -110,21 +116,35 @@ namespace eosiosystem {
             { _self, saving_account, asset(to_savings, core_symbol()), "unallocated inflation" }
          );
 
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {_self, active_permission} },
-            { _self, bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" }
-         );
+         if( fund_buckets ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {_self, active_permission} },
+               { _self, bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" }
+            );
 
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {_self, active_permission} },
-            { _self, vpay_account, asset(to_per_vote_pay, core_symbol()), "fund per-vote bucket" }
-         );
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {_self, active_permission} },
+               { _self, vpay_account, asset(to_per_vote_pay, core_symbol()), "fund per-vote bucket" }
+            );
+         }
 
          _gstate.pervote_bucket          += to_per_vote_pay;
          _gstate.perblock_bucket         += to_per_block_pay;
          _gstate.last_pervote_bucket_fill = TIME_TO_I64(ct);
+         _gstate_dirty = true;
+
+         funded.block_pay = to_per_block_pay;
+         funded.vote_pay  = to_per_vote_pay;
       }
+      return funded;
+   }
 
+   /**
+    *  Computes the block pay and vote pay owed to `prod` at `ct` and takes them out of the buckets, exactly
+    *  as a claim of that producer would. The voter bonus share is left in the vote pay bucket.
+    */
+   producer_pay system_contract::claim_producer_pay( const producer_info& prod, time_point ct, const name& payer ) {
+      const name owner = prod.owner;
       auto prod2 = _producers2.find( owner.value );
 
       /// New metric to be used in pervote pay calculation. Instead of vote weight ratio, we combine vote weight and
@@ -136,7 +156,7 @@ namespace eosiosystem {
       if ( prod2 != _producers2.end() ) {
          updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
       } else {
-         prod2 = _producers2.emplace( owner, [&]( producer_info2& info  ) {
+         prod2 = _producers2.emplace( payer, [&]( producer_info2& info  ) {
             info.owner                     = owner;
             info.last_votepay_share_update = ct;
          });
@@ -148,8 +168,9 @@ namespace eosiosystem {
       // In fact it is desired behavior because the producers votes need to be counted in the global total_producer_votepay_share for the first time.
 
       int64_t producer_per_block_pay = 0;
-      if( _gstate.total_unpaid_blocks > 0 ) {
-         producer_per_block_pay = (_gstate.perblock_bucket * prod.unpaid_blocks) / _gstate.total_unpaid_blocks;
+      auto& bs = block_stats();
+      if( bs.total_unpaid_blocks > 0 ) {
+         producer_per_block_pay = (_gstate.perblock_bucket * prod.unpaid_blocks) / bs.total_unpaid_blocks;
       }
 
       double new_votepay_share = update_producer_votepay_share( prod2,
@@ -178,7 +199,9 @@ namespace eosiosystem {
 
       _gstate.pervote_bucket      -= producer_per_vote_pay;
       _gstate.perblock_bucket     -= producer_per_block_pay;
-      _gstate.total_unpaid_blocks -= prod.unpaid_blocks;
+      bs.total_unpaid_blocks      -= prod.unpaid_blocks;
+      _gstate_dirty = true;
+      _gblock_dirty = true;
 
       update_total_votepay_share( ct, -new_votepay_share, (updated_after_threshold ? prod.total_votes : 0.0) );
 
@@ -187,85 +210,150 @@ namespace eosiosystem {
          p.unpaid_blocks   = 0;
       });
 
-      if( producer_per_block_pay > 0 ) {
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {bpay_account, active_permission}, {owner, active_permission} },
-            { bpay_account, owner, asset(producer_per_block_pay, core_symbol()), std::string("producer block pay") }
-         );
-      }
-      if( producer_per_vote_pay > 0 ) {
-         if (_gstate.to_voter_bonus_rate > 0) {
-            auto voter_bonus_pay = static_cast<int64_t>(producer_per_vote_pay * _gstate.to_voter_bonus_rate);
-            if (voter_bonus_pay > 0) {
-               producer_per_vote_pay -= voter_bonus_pay;
-
-               auto vb_itr = _voterbonus.find(owner.value);
-               if (vb_itr == _voterbonus.end()) {
-                  _voterbonus.emplace( owner, [&]( auto& vb ) {
-                     vb.producer = owner;
-                     vb.balance = asset(voter_bonus_pay, core_symbol());
-                  });
-               } else {
-                  _voterbonus.modify( vb_itr, same_payer, [&]( auto& vb ) {
-                      vb.balance += asset(voter_bonus_pay, core_symbol());
-                  });
-               }
-            }
+      /// a legacy voter bonus balance is still held by the vote pay bucket, so hand it to the producer's voters
+      auto vb_itr = _voterbonus.find( owner.value );
+      if (vb_itr != _voterbonus.end() && prod.total_votes > 0) {
+         producer_bonus_table bonus( _self, _self.value );
+         auto bitr = bonus.find( owner.value );
+         if (bitr == bonus.end()) {
+            bonus.emplace( payer, [&]( auto& b ) {
+               b.producer       = owner;
+               b.bonus_per_vote = vb_itr->balance.amount / prod.total_votes;
+            });
+         } else {
+            bonus.modify( bitr, same_payer, [&]( auto& b ) {
+               b.bonus_per_vote += vb_itr->balance.amount / prod.total_votes;
+            });
          }
+         _voterbonus.erase( vb_itr );
+      }
 
-         if (producer_per_vote_pay > 0) {
-            INLINE_ACTION_SENDER(eosio::token, transfer)(
-               token_account, { {vpay_account, active_permission}, {owner, active_permission} },
-               { vpay_account, owner, asset(producer_per_vote_pay, core_symbol()), std::string("producer vote pay") }
-            );
+      if (producer_per_vote_pay > 0 && _gstate.to_voter_bonus_rate > 0) {
+         auto voter_bonus_pay = static_cast<int64_t>(producer_per_vote_pay * _gstate.to_voter_bonus_rate);
+         if (voter_bonus_pay > 0 && prod.total_votes > 0) {
+            producer_per_vote_pay -= voter_bonus_pay;
+
+            /// only the producer's accumulator is updated, voters settle against it when they claim
+            producer_bonus_table bonus( _self, _self.value );
+            auto bitr = bonus.find( owner.value );
+            if (bitr == bonus.end()) {
+               bonus.emplace( payer, [&]( auto& b ) {
+                  b.producer       = owner;
+                  b.bonus_per_vote = voter_bonus_pay / prod.total_votes;
+               });
+            } else {
+               bonus.modify( bitr, same_payer, [&]( auto& b ) {
+                  b.bonus_per_vote += voter_bonus_pay / prod.total_votes;
+               });
+            }
          }
       }
+
+      producer_pay pay;
+      pay.block_pay = producer_per_block_pay;
+      pay.vote_pay  = producer_per_vote_pay;
+      return pay;
    }
 
-   void system_contract::claimbonus( const name owner ) {
-      require_auth(owner);
+   void system_contract::claimrewards( const name owner ) {
+      require_auth( owner );
 
-      const auto& voter = _voters.get(owner.value);
+      const auto& prod = _producers.get( owner.value );
+      check( prod.active(), "producer does not have an active key" );
+
+      check( _gstate.total_activated_stake >= _gstate.min_activated_stake,
+                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
 
       const auto ct = current_time_point();
-      check( ct - time_point(microseconds::maximum()) > microseconds(_gstate.useconds_per_day), "already claimed bonus or voted producers or delegated/undelegated within past day" );
 
-      double vote_weight = voter.last_vote_weight;
-      if (voter.is_proxy) {
-         vote_weight -= voter.proxied_vote_weight;
-      }
+      check( ct - prod.last_claim_time > microseconds(_gstate.useconds_per_day), "already claimed rewards within past day" );
 
-      std::vector<name> producers;
-      if (voter.proxy) {
-         const auto& proxy = _voters.get(voter.proxy.value);
-         producers = proxy.producers;
-         // TODO: should consider proxy's last_change_time?
-      } else {
-         producers = voter.producers;
+      fill_pay_buckets( ct, true );
+      const auto pay = claim_producer_pay( prod, ct, owner );
+
+      if( pay.block_pay > 0 ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {bpay_account, active_permission}, {owner, active_permission} },
+            { bpay_account, owner, asset(pay.block_pay, core_symbol()), std::string("producer block pay") }
+         );
+      }
+      if( pay.vote_pay > 0 ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {vpay_account, active_permission}, {owner, active_permission} },
+            { vpay_account, owner, asset(pay.vote_pay, core_symbol()), std::string("producer vote pay") }
+         );
       }
+   }
 
-      _voters.modify( voter, same_payer, [&]( auto& v ) {
-         //v.last_change_time = ct;
-      });
+   void system_contract::claimall( const name& caller, uint16_t max ) {
+      require_auth( caller );
+      check( max > 0, "max must be positive" );
 
-      int64_t amount = 0;
-      for (auto& p: producers) {
-         const auto& producer = _producers.get(p.value);
-         const auto& voterbonus = _voterbonus.find(p.value);
-         if (voterbonus == _voterbonus.end()) continue;
-         auto delta = static_cast<int64_t>(voterbonus->balance.amount * vote_weight / producer.total_votes);
-         if (delta <= 0) continue;
-         _voterbonus.modify( *voterbonus, same_payer, [&]( auto& vb ) {
-             vb.balance -= asset(delta, core_symbol());
-         });
-         amount += delta;
+      check( _gstate.total_activated_stake >= _gstate.min_activated_stake,
+                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
+
+      const auto ct = current_time_point();
+
+      /// the inflation is issued once, and the producers are paid straight from the system account
+      const auto funded = fill_pay_buckets( ct, false );
+
+      producer_pay paid;
+      auto idx = _producers.get_index<"prototalvote"_n>();
+      for( auto it = idx.cbegin(); it != idx.cend() && max > 0; ++it ) {
+         if( !it->active() ) {
+            /// inactive producers sort after the active ones, except those without votes
+            if( it->total_votes > 0 )
+               break;
+            continue;
+         }
+         if( ct - it->last_claim_time <= microseconds(_gstate.useconds_per_day) )
+            continue;
+         --max;
+
+         const auto pay = claim_producer_pay( *it, ct, _self );
+         paid.block_pay += pay.block_pay;
+         paid.vote_pay  += pay.vote_pay;
+         if( pay.block_pay + pay.vote_pay > 0 ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {_self, active_permission} },
+               { _self, it->owner, asset(pay.block_pay + pay.vote_pay, core_symbol()), std::string("producer pay") }
+            );
+         }
       }
-      if (amount > 0) {
+
+      /// settle each bucket account with the net of what it was funded and what was paid on its behalf
+      settle_pay_bucket( bpay_account, funded.block_pay - paid.block_pay, "fund per-block bucket" );
+      settle_pay_bucket( vpay_account, funded.vote_pay - paid.vote_pay, "fund per-vote bucket" );
+   }
+
+   void system_contract::settle_pay_bucket( const name& bucket, int64_t net, const std::string& memo ) {
+      if( net > 0 ) {
          INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, {{vpay_account, active_permission}, {owner,active_permission}},
-            {vpay_account, owner, asset(amount, core_symbol()), std::string("voter bonus pay")}
+            token_account, { {_self, active_permission} },
+            { _self, bucket, asset(net, core_symbol()), memo }
+         );
+      } else if( net < 0 ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {bucket, active_permission} },
+            { bucket, _self, asset(-net, core_symbol()), std::string("producer pay") }
          );
       }
    }
 
+   void system_contract::claimbonus( const name owner ) {
+      require_auth(owner);
+
+      const auto& voter = _voters.get(owner.value);
+
+      /// the weight is the one settled when it last changed, so staking right before a claim earns nothing extra
+      const double bonus_per_vote = voter_bonus_per_vote(voter);
+      const int64_t amount = settle_voter_bonus(voter, bonus_per_vote, bonus_per_vote, 0, true);
+      check( amount > 0, "no voter bonus to claim" );
+
+      INLINE_ACTION_SENDER(eosio::token, transfer)(
+         token_account, {{vpay_account, active_permission}, {owner,active_permission}},
+         {vpay_account, owner, asset(amount, core_symbol()), std::string("voter bonus pay")}
+      );
+   }
+
 } //namespace eosiosystem
@@ -64,7 +64,7 @@ namespace eosiosystem {
       transfer_from_fund( from, amount );
       const asset rex_received    = add_to_rex_pool( amount );
       const asset delta_rex_stake = add_to_rex_balance( from, amount, rex_received );
-      runrex(2);
+      run_rex_maintenance();
       update_rex_account( from, asset( 0, core_symbol() ), delta_rex_stake );
       // dummy action added so that amount of REX tokens purchased shows up in action trace 
       rex_results::buyresult_action buyrex_act( rex_account, std::vector<eosio::permission_level>{ } );
@@ -112,7 +112,7 @@ namespace eosiosystem {
       }
       const asset rex_received = add_to_rex_pool( payment );
       add_to_rex_balance( owner, payment, rex_received );
-      runrex(2);
+      run_rex_maintenance();
       update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ), true );
       // dummy action added so that amount of REX tokens purchased shows up in action trace
       rex_results::buyresult_action buyrex_act( rex_account, std::vector<eosio::permission_level>{ } );
@@ -129,7 +129,7 @@ namespace eosiosystem {
    {
       require_auth( from );
 
-      runrex(2);
+      run_rex_maintenance();
 
       auto bitr = _rexbalance.require_find( from.value, "user must first buyrex" );
       check( rex.amount > 0 && rex.symbol == bitr->rex_balance.symbol,
@@ -186,7 +186,12 @@ namespace eosiosystem {
 
       auto itr = _rexorders.require_find( owner.value, "no sellrex order is scheduled" );
       check( itr->is_open, "sellrex order has been filled and cannot be canceled" );
+      const asset proceeds     = itr->proceeds;
+      const asset stake_change = itr->stake_change;
       _rexorders.erase( itr );
+      /// deliver what has already been partially filled
+      if ( proceeds.amount > 0 || stake_change.amount != 0 )
+         update_rex_account( owner, proceeds, stake_change );
    }
 
    /**
@@ -302,7 +307,7 @@ namespace eosiosystem {
    {
       require_auth( owner );
 
-      runrex(2);
+      run_rex_maintenance();
 
       auto itr = _rexbalance.require_find( owner.value, "account has no REX balance" );
       const asset init_stake = itr->vote_stake;
@@ -355,6 +360,72 @@ namespace eosiosystem {
       runrex( max );
    }
 
+   /**
+    * @brief Sets the amount of REX maintenance done by user actions and by the rexmaint crank
+    *
+    * @param user_backlog - user actions only process loans and orders while more than this many are due,
+    * 0 processes them on every user action
+    * @param user_batch - number of each of CPU loans, NET loans, and sell orders processed by a user action
+    * @param crank_batch - upper bound of each of CPU loans, NET loans, and sell orders processed by rexmaint
+    * @param reward_per_item - amount paid to the rexmaint caller for each processed loan or order, at most a tenth of its
+    * payment or proceeds
+    * @param partial_fills - if true, queued sellrex orders that cannot be filled entirely are filled
+    * partially and stay open for the remainder
+    */
+   void system_contract::setrexmaint( uint32_t user_backlog, uint16_t user_batch, uint16_t crank_batch, const asset& reward_per_item,
+                                      bool partial_fills )
+   {
+      require_auth( _self );
+
+      check( 0 < crank_batch, "crank_batch must be positive" );
+      check( reward_per_item.symbol == core_symbol(), "reward must use core token" );
+      check( 0 <= reward_per_item.amount, "reward must be non-negative" );
+
+      rex_maintenance_config config;
+      config.user_backlog    = user_backlog;
+      config.user_batch      = user_batch;
+      config.crank_batch     = crank_batch;
+      config.reward_per_item = reward_per_item.amount;
+      config.partial_fills   = partial_fills;
+      rex_maintenance_singleton( _self, _self.value ).set( config, _self );
+      _rexmaint = config;
+   }
+
+   /**
+    * @brief Performs REX maintenance and rewards the caller for it
+    *
+    * The reward is paid by REX holders out of the pool's lendable tokens. Each item earns at most a
+    * tenth of its loan payment or order proceeds, and nothing is paid unless the pool keeps enough
+    * unlent tokens to fill sell orders.
+    *
+    * @param caller - any user can execute this action
+    * @param max - number of each of CPU loans, NET loans, and sell orders to be processed, capped by crank_batch
+    */
+   void system_contract::rexmaint( const name& caller, uint16_t max )
+   {
+      require_auth( caller );
+
+      check( 0 < max, "max must be positive" );
+      check( rex_system_initialized(), "rex system not initialized yet" );
+
+      const auto& config = rex_maintenance();
+      const auto result = runrex( std::min( max, config.crank_batch ) );
+      check( 0 < result.first, "no REX maintenance due" );
+
+      const int64_t reward = result.second;
+      if ( 0 < reward ) {
+         const auto& pool = _rexpool.begin();
+         const int64_t unlent_lower_bound = ( uint128_t(2) * pool->total_lent.amount ) / 10;
+         if ( reward <= pool->total_unlent.amount - unlent_lower_bound ) {
+            _rexpool.modify( pool, same_payer, [&]( auto& rt ) {
+               rt.total_unlent.amount   -= reward;
+               rt.total_lendable.amount -= reward;
+            });
+            transfer_to_fund( caller, asset( reward, core_symbol() ) );
+         }
+      }
+   }
+
    /**
     * @brief Consolidates REX maturity buckets into one bucket that cannot be sold before
     * 4 days
@@ -365,7 +436,7 @@ namespace eosiosystem {
    {
       require_auth( owner );
 
-      runrex(2);
+      run_rex_maintenance();
 
       auto bitr = _rexbalance.require_find( owner.value, "account has no REX balance" );
       asset rex_in_sell_order = update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ) );
@@ -382,7 +453,7 @@ namespace eosiosystem {
    {
       require_auth( owner );
 
-      runrex(2);
+      run_rex_maintenance();
 
       auto bitr = _rexbalance.require_find( owner.value, "account has no REX balance" );
       check( rex.amount > 0 && rex.symbol == bitr->rex_balance.symbol, "asset must be a positive amount of (REX, 4)" );
@@ -393,6 +464,17 @@ namespace eosiosystem {
       process_rex_maturities( bitr );
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
          int64_t moved_rex = 0;
+         if ( rb.maturity_buckets.has_value() ) {
+            auto& mb = rb.maturity_buckets.value();
+            while ( !mb.buckets.empty() && moved_rex < rex.amount ) {
+               const int64_t drex = std::min( rex.amount - moved_rex, mb.buckets.back() );
+               mb.buckets.back() -= drex;
+               moved_rex         += drex;
+               if ( mb.buckets.back() == 0 ) {
+                  mb.buckets.pop_back();
+               }
+            }
+         }
          while ( !rb.rex_maturities.empty() && moved_rex < rex.amount) {
             const int64_t drex = std::min( rex.amount - moved_rex, rb.rex_maturities.back().second );
             rb.rex_maturities.back().second -= drex;
@@ -422,7 +504,7 @@ namespace eosiosystem {
    {
       require_auth( owner );
 
-      runrex(2);
+      run_rex_maintenance();
 
       auto bitr = _rexbalance.require_find( owner.value, "account has no REX balance" );
       check( rex.amount > 0 && rex.symbol == bitr->rex_balance.symbol, "asset must be a positive amount of (REX, 4)" );
@@ -430,12 +512,7 @@ namespace eosiosystem {
       check( rex.amount <= rex_in_savings, "insufficient REX in savings" );
       process_rex_maturities( bitr );
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
-         const time_point_sec maturity = get_rex_maturity();
-         if ( !rb.rex_maturities.empty() && rb.rex_maturities.back().first == maturity ) {
-            rb.rex_maturities.back().second += rex.amount;
-         } else {
-            rb.rex_maturities.emplace_back( maturity, rex.amount );
-         }
+         add_to_rex_maturity( rb, get_rex_maturity(), rex.amount );
       });
       put_rex_savings( bitr, rex_in_savings - rex.amount );
       update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ) );
@@ -451,7 +528,7 @@ namespace eosiosystem {
       require_auth( owner );
 
       if ( rex_system_initialized() )
-         runrex(2);
+         run_rex_maintenance();
 
       update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ) );
 
@@ -483,6 +560,39 @@ namespace eosiosystem {
       }
    }
 
+   /**
+    * @brief Quotes the REX tokens buyrex would issue for a core token amount
+    *
+    * The result is sent as a quoteresult notification and no state is written. Like every
+    * quote it reflects the REX pool as of its last update; a buyrex in the same block may
+    * first process expired loans.
+    *
+    * @param amount - amount of core tokens to be used for purchase
+    */
+   void system_contract::quoterexbuy( const asset& amount )
+   {
+      check( amount.symbol == core_symbol(), "asset must be core token" );
+      check( 0 < amount.amount, "must use positive amount" );
+      check( rex_available(), "rex system not initialized yet" );
+      check( _rexpool.begin()->total_lendable.amount > 0, "lendable REX pool is empty" );
+
+      send_quote( amount, asset( rex_for_payment( *_rexpool.begin(), amount.amount ), rex_symbol ) );
+   }
+
+   /**
+    * @brief Quotes the core token proceeds of selling REX tokens
+    *
+    * @param rex - amount of REX tokens to be sold
+    */
+   void system_contract::quoterexsell( const asset& rex )
+   {
+      check( rex.symbol == rex_symbol && 0 < rex.amount, "asset must be a positive amount of (REX, 4)" );
+      check( rex_available(), "rex system not initialized yet" );
+      check( rex.amount <= _rexpool.begin()->total_rex.amount, "cannot sell more REX than issued" );
+
+      send_quote( rex, asset( rex_proceeds( *_rexpool.begin(), rex.amount ), core_symbol() ) );
+   }
+
    /**
     * Given two connector balances (conin, and conout), and an incoming amount of
     * in, this function calculates the delta out using Banacor equation.
@@ -495,6 +605,11 @@ namespace eosiosystem {
     */
    int64_t get_bancor_output( int64_t conin, int64_t conout, int64_t in )
    {
+      int64_t fixed_out = 0;
+      if( FIXED_POINT_BANCOR && bancor::output( conin, conout, in, fixed_out ) ) {
+         return fixed_out;
+      }
+
       const double F0 = double(conin);
       const double T0 = double(conout);
       const double I  = double(in);
@@ -506,6 +621,24 @@ namespace eosiosystem {
       return out;
    }
 
+   /**
+    * @brief Quotes the tokens staked by a CPU or NET loan for a loan payment
+    *
+    * @param payment - loan payment
+    */
+   void system_contract::quoterent( const asset& payment )
+   {
+      check( rex_loans_available(), "rex loans are currently not available" );
+      check( payment.symbol == core_symbol(), "must use core token" );
+      check( 0 < payment.amount, "must use positive asset amount" );
+
+      const auto& pool = _rexpool.begin();
+      const int64_t rented_tokens = get_bancor_output( pool->total_rent.amount, pool->total_unlent.amount, payment.amount );
+      check( payment.amount < rented_tokens, "loan price does not favor renting" );
+
+      send_quote( payment, asset( rented_tokens, core_symbol() ) );
+   }
+
    /**
     * @brief Updates account NET and CPU resource limits
     *
@@ -574,7 +707,7 @@ namespace eosiosystem {
    void system_contract::check_voting_requirement( const name& owner, const char* error_msg )const
    {
       auto vitr = _voters.find( owner.value );
-      check( vitr != _voters.end() && ( vitr->proxy || 21 <= vitr->producers.size() ), error_msg );
+      check( vitr != _voters.end() && ( vitr->proxy || 21 <= vitr->producers_count() ), error_msg );
    }
 
    /**
@@ -600,47 +733,44 @@ namespace eosiosystem {
    /**
     * @brief Updates rex_pool balances upon creating a new loan or renewing an existing one
     *
+    * @param pool - rex_pool balances to be updated, written back by the caller
     * @param payment - loan fee paid
     * @param rented_tokens - amount of tokens to be staked to loan receiver
     * @param new_loan - flag indicating whether the loan is new or being renewed
     */
-   void system_contract::add_loan_to_rex_pool( const asset& payment, int64_t rented_tokens, bool new_loan )
+   void system_contract::add_loan_to_rex_pool( rex_pool& pool, const asset& payment, int64_t rented_tokens, bool new_loan )
    {
-      _rexpool.modify( _rexpool.begin(), same_payer, [&]( auto& rt ) {
-         // add payment to total_rent
-         rt.total_rent.amount    += payment.amount;
-         // move rented_tokens from total_unlent to total_lent
-         rt.total_unlent.amount  -= rented_tokens;
-         rt.total_lent.amount    += rented_tokens;
-         // add payment to total_unlent
-         rt.total_unlent.amount  += payment.amount;
-         rt.total_lendable.amount = rt.total_unlent.amount + rt.total_lent.amount;
-         // increment loan_num if a new loan is being created
-         if ( new_loan ) {
-            rt.loan_num++;
-         }
-      });
+      // add payment to total_rent
+      pool.total_rent.amount    += payment.amount;
+      // move rented_tokens from total_unlent to total_lent
+      pool.total_unlent.amount  -= rented_tokens;
+      pool.total_lent.amount    += rented_tokens;
+      // add payment to total_unlent
+      pool.total_unlent.amount  += payment.amount;
+      pool.total_lendable.amount = pool.total_unlent.amount + pool.total_lent.amount;
+      // increment loan_num if a new loan is being created
+      if ( new_loan ) {
+         pool.loan_num++;
+      }
    }
 
    /**
     * @brief Updates rex_pool balances upon closing an expired loan
     *
+    * @param pool - rex_pool balances to be updated, written back by the caller
     * @param loan - loan to be closed
     */
-   void system_contract::remove_loan_from_rex_pool( const rex_loan& loan )
+   void system_contract::remove_loan_from_rex_pool( rex_pool& pool, const rex_loan& loan )
    {
-      const auto& pool = _rexpool.begin();
-      const int64_t delta_total_rent = get_bancor_output( pool->total_unlent.amount,
-                                                          pool->total_rent.amount,
+      const int64_t delta_total_rent = get_bancor_output( pool.total_unlent.amount,
+                                                          pool.total_rent.amount,
                                                           loan.total_staked.amount );
-      _rexpool.modify( pool, same_payer, [&]( auto& rt ) {
-         // deduct calculated delta_total_rent from total_rent
-         rt.total_rent.amount    -= delta_total_rent;
-         // move rented tokens from total_lent to total_unlent
-         rt.total_unlent.amount  += loan.total_staked.amount;
-         rt.total_lent.amount    -= loan.total_staked.amount;
-         rt.total_lendable.amount = rt.total_unlent.amount + rt.total_lent.amount;
-      });
+      // deduct calculated delta_total_rent from total_rent
+      pool.total_rent.amount    -= delta_total_rent;
+      // move rented tokens from total_lent to total_unlent
+      pool.total_unlent.amount  += loan.total_staked.amount;
+      pool.total_lent.amount    -= loan.total_staked.amount;
+      pool.total_lendable.amount = pool.total_unlent.amount + pool.total_lent.amount;
    }
 
    /**
@@ -661,22 +791,38 @@ namespace eosiosystem {
    /**
     * @brief Performs maintenance operations on expired NET and CPU loans and sellrex oders
     *
+    * Loans and orders are processed one after the other against a working copy of rex_pool, so
+    * every loan is priced exactly as if the pool had been written after each of them, and the
+    * pool row is written once at the end of the batch.
+    *
     * @param max - maximum number of each of the three categories to be processed
+    *
+    * @return pair - number of loans closed or renewed and sell orders filled, and the rexmaint reward
+    * they earned
     */
-   void system_contract::runrex( uint16_t max )
+   std::pair<uint32_t, int64_t> system_contract::runrex( uint16_t max )
    {
       check( rex_system_initialized(), "rex system not initialized yet" );
 
-      const auto& pool = _rexpool.begin();
+      rex_pool pool       = *_rexpool.begin();
+      bool     pool_dirty = false;
+      uint32_t processed  = 0;
+      int64_t  reward     = 0;
+
+      /// an item earns at most a tenth of its payment or proceeds, so minimum-payment loans cannot farm the reward
+      auto add_reward = [&]( int64_t amount ) {
+         reward += std::min( rex_maintenance().reward_per_item, amount / 10 );
+      };
 
       auto process_expired_loan = [&]( auto& idx, const auto& itr ) -> std::pair<bool, int64_t> {
          /// update rex_pool in order to delete existing loan
-         remove_loan_from_rex_pool( *itr );
+         remove_loan_from_rex_pool( pool, *itr );
+         pool_dirty = true;
          bool    delete_loan   = false;
          int64_t delta_stake   = 0;
          /// calculate rented tokens at current price
-         int64_t rented_tokens = get_bancor_output( pool->total_rent.amount,
-                                                    pool->total_unlent.amount,
+         int64_t rented_tokens = get_bancor_output( pool.total_rent.amount,
+                                                    pool.total_unlent.amount,
                                                     itr->payment.amount );
          /// conditions for loan renewal
          bool renew_loan = itr->payment <= itr->balance        /// loan has sufficient balance 
@@ -684,7 +830,7 @@ namespace eosiosystem {
                         && rex_loans_available();              /// no pending sell orders
          if ( renew_loan ) {
             /// update rex_pool in order to account for renewed loan 
-            add_loan_to_rex_pool( itr->payment, rented_tokens, false );
+            add_loan_to_rex_pool( pool, itr->payment, rented_tokens, false );
             /// update renewed loan fields
             delta_stake = update_renewed_loan( idx, itr, rented_tokens );
          } else {
@@ -700,11 +846,10 @@ namespace eosiosystem {
       };
 
       /// transfer from eosio.names to eosio.rex
-      if ( pool->namebid_proceeds.amount > 0 ) {
-         channel_to_rex( names_account, pool->namebid_proceeds );
-         _rexpool.modify( pool, same_payer, [&]( auto& rt ) {
-            rt.namebid_proceeds.amount = 0;
-         });
+      if ( pool.namebid_proceeds.amount > 0 ) {
+         channel_to_rex( pool, names_account, pool.namebid_proceeds );
+         pool.namebid_proceeds.amount = 0;
+         pool_dirty = true;
       }
 
       /// process cpu loans
@@ -715,7 +860,9 @@ namespace eosiosystem {
             auto itr = cpu_idx.begin();
             if ( itr == cpu_idx.end() || itr->expiration > current_time_point() ) break;
 
+            add_reward( itr->payment.amount );
             auto result = process_expired_loan( cpu_idx, itr );
+            ++processed;
             if ( result.second != 0 )
                update_resource_limits( itr->from, itr->receiver, 0, result.second );
 
@@ -732,7 +879,9 @@ namespace eosiosystem {
             auto itr = net_idx.begin();
             if ( itr == net_idx.end() || itr->expiration > current_time_point() ) break;
 
+            add_reward( itr->payment.amount );
             auto result = process_expired_loan( net_idx, itr );
+            ++processed;
             if ( result.second != 0 )
                update_resource_limits( itr->from, itr->receiver, result.second, 0 );
 
@@ -751,29 +900,115 @@ namespace eosiosystem {
             ++next;
             auto bitr = _rexbalance.find( oitr->owner.value );
             if ( bitr != _rexbalance.end() ) { // should always be true
-               auto result = fill_rex_order( bitr, oitr->rex_requested );
+               auto result = fill_rex_order( pool, bitr, oitr->rex_requested );
                if ( result.success ) {
+                  pool_dirty = true;
+                  ++processed;
+                  add_reward( result.proceeds.amount );
                   const name order_owner = oitr->owner;
                   idx.modify( oitr, same_payer, [&]( auto& order ) {
-                     order.proceeds.amount     = result.proceeds.amount;
-                     order.stake_change.amount = result.stake_change.amount;
+                     order.proceeds.amount     += result.proceeds.amount;
+                     order.stake_change.amount += result.stake_change.amount;
                      order.close();
                   });
                   /// send dummy action to show owner and proceeds of filled sellrex order
                   rex_results::orderresult_action order_act( rex_account, std::vector<eosio::permission_level>{ } );
                   order_act.send( order_owner, result.proceeds );
+               } else if ( rex_maintenance().partial_fills ) {
+                  /// sell as much of the order as the pool can pay out, the rest stays queued; a partial fill
+                  /// must sell at least a tenth of what is left of the order, so that a pool freeing up
+                  /// tokens bit by bit does not have every pass sell and write a dust slice
+                  const int64_t S0         = pool.total_lendable.amount;
+                  const int64_t R0         = pool.total_rex.amount;
+                  const int64_t available  = pool.total_unlent.amount - ( uint128_t(2) * pool.total_lent.amount ) / 10;
+                  const int64_t rex_filled = available > 0 ? int64_t( ( uint128_t(available) * R0 ) / S0 ) : 0;
+                  if ( oitr->rex_requested.amount / min_partial_fill_divisor <= rex_filled
+                       && 0 < rex_filled && 0 < ( uint128_t(rex_filled) * S0 ) / R0 ) {
+                     auto part = fill_rex_order( pool, bitr, asset( rex_filled, rex_symbol ) );
+                     if ( part.success ) {
+                        pool_dirty = true;
+                        ++processed;
+                        add_reward( part.proceeds.amount );
+                        idx.modify( oitr, same_payer, [&]( auto& order ) {
+                           order.rex_requested.amount -= rex_filled;
+                           order.proceeds.amount      += part.proceeds.amount;
+                           order.stake_change.amount  += part.stake_change.amount;
+                        });
+                     }
+                  }
+                  /// orders further down the queue cannot be filled from what is left
+                  break;
                }
             }
             oitr = next;
          }
       }
 
+      if ( pool_dirty ) {
+         _rexpool.modify( _rexpool.begin(), same_payer, [&]( auto& rt ) {
+            rt = pool;
+         });
+      }
+
+      return { processed, reward };
+   }
+
+   /**
+    * @brief Performs the REX maintenance that is due on user actions
+    *
+    * With the default configuration every user action processes up to 2 loans and orders of each
+    * kind. Once a backlog threshold is set, user actions leave maintenance to the rexmaint crank
+    * unless more than that many loans and orders are due.
+    */
+   void system_contract::run_rex_maintenance()
+   {
+      check( rex_system_initialized(), "rex system not initialized yet" );
+
+      const auto& config = rex_maintenance();
+      if ( config.user_backlog == 0 || config.user_backlog < rex_backlog( config.user_backlog + 1 ) ) {
+         runrex( config.user_batch );
+      }
+   }
+
+   /**
+    * @brief Counts expired loans and open sellrex orders, and pending namebid proceeds, up to limit
+    */
+   uint32_t system_contract::rex_backlog( uint32_t limit )
+   {
+      uint32_t due = _rexpool.begin()->namebid_proceeds.amount > 0 ? 1 : 0;
+      const auto ct = current_time_point();
+      {
+         rex_cpu_loan_table cpu_loans( _self, _self.value );
+         auto cpu_idx = cpu_loans.get_index<"byexpr"_n>();
+         for ( auto itr = cpu_idx.begin(); due < limit && itr != cpu_idx.end() && itr->expiration <= ct; ++itr )
+            ++due;
+      }
+      {
+         rex_net_loan_table net_loans( _self, _self.value );
+         auto net_idx = net_loans.get_index<"byexpr"_n>();
+         for ( auto itr = net_idx.begin(); due < limit && itr != net_idx.end() && itr->expiration <= ct; ++itr )
+            ++due;
+      }
+      {
+         auto idx = _rexorders.get_index<"bytime"_n>();
+         for ( auto itr = idx.begin(); due < limit && itr != idx.end() && itr->is_open; ++itr )
+            ++due;
+      }
+      return due;
+   }
+
+   const rex_maintenance_config& system_contract::rex_maintenance()
+   {
+      if ( !_rexmaint ) {
+         _rexmaint = rex_maintenance_singleton( _self, _self.value ).get_or_default();
+      }
+      return *_rexmaint;
    }
 
    template <typename T>
    int64_t system_contract::rent_rex( T& table, const name& from, const name& receiver, const asset& payment, const asset& fund )
    {
-      runrex(2);
+      run_rex_maintenance();
 
       check( rex_loans_available(), "rex loans are currently not available" );
       check( payment.symbol == core_symbol() && fund.symbol == core_symbol(), "must use core token" );
@@ -785,7 +1020,9 @@ namespace eosiosystem {
 
       int64_t rented_tokens = get_bancor_output( pool->total_rent.amount, pool->total_unlent.amount, payment.amount );
       check( payment.amount < rented_tokens, "loan price does not favor renting" );
-      add_loan_to_rex_pool( payment, rented_tokens, true );
+      _rexpool.modify( pool, same_payer, [&]( auto& rt ) {
+         add_loan_to_rex_pool( rt, payment, rented_tokens, true );
+      });
 
       table.emplace( from, [&]( auto& c ) {
          c.from         = from;
@@ -820,26 +1057,48 @@ namespace eosiosystem {
     */
    rex_order_outcome system_contract::fill_rex_order( const rex_balance_table::const_iterator& bitr, const asset& rex )
    {
-      auto rexitr = _rexpool.begin();
-      const int64_t S0 = rexitr->total_lendable.amount;
-      const int64_t R0 = rexitr->total_rex.amount;
-      const int64_t p  = (uint128_t(rex.amount) * S0) / R0;
+      rex_pool pool = *_rexpool.begin();
+      const auto result = fill_rex_order( pool, bitr, rex );
+      if ( result.success ) {
+         _rexpool.modify( _rexpool.begin(), same_payer, [&]( auto& rt ) {
+            rt = pool;
+         });
+      }
+      return result;
+   }
+
+   /**
+    * @brief Processes a sellrex order against rex_pool balances held by the caller
+    *
+    * Same as above, except that the updated pool balances are left in `pool` for the caller to
+    * write, which lets runrex fill a batch of orders with a single rex_pool write.
+    *
+    * @param pool - rex_pool balances, updated if the order is filled
+    * @param bitr - iterator pointing to rex_balance database record
+    * @param rex - amount of rex to be sold
+    *
+    * @return rex_order_outcome - a struct containing success flag, order proceeds, and resultant
+    * vote stake change
+    */
+   rex_order_outcome system_contract::fill_rex_order( rex_pool& pool, const rex_balance_table::const_iterator& bitr, const asset& rex )
+   {
+      const int64_t S0 = pool.total_lendable.amount;
+      const int64_t R0 = pool.total_rex.amount;
+      const int64_t p  = rex_proceeds( pool, rex.amount );
       const int64_t R1 = R0 - rex.amount;
       const int64_t S1 = S0 - p;
       asset proceeds( p, core_symbol() );
       asset stake_change( 0, core_symbol() );
       bool  success = false;
 
-      const int64_t unlent_lower_bound = ( uint128_t(2) * rexitr->total_lent.amount ) / 10;
-      const int64_t available_unlent   = rexitr->total_unlent.amount - unlent_lower_bound; // available_unlent <= 0 is possible
+      const int64_t unlent_lower_bound = ( uint128_t(2) * pool.total_lent.amount ) / 10;
+      const int64_t available_unlent   = pool.total_unlent.amount - unlent_lower_bound; // available_unlent <= 0 is possible
       if ( proceeds.amount <= available_unlent ) {
          const int64_t init_vote_stake_amount = bitr->vote_stake.amount;
          const int64_t current_stake_value    = ( uint128_t(bitr->rex_balance.amount) * S0 ) / R0;
-         _rexpool.modify( rexitr, same_payer, [&]( auto& rt ) {
-            rt.total_rex.amount      = R1;
-            rt.total_lendable.amount = S1;
-            rt.total_unlent.amount   = rt.total_lendable.amount - rt.total_lent.amount;
-         });
+         pool.total_rex.amount      = R1;
+         pool.total_lendable.amount = S1;
+         pool.total_unlent.amount   = pool.total_lendable.amount - pool.total_lent.amount;
          _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
             rb.vote_stake.amount   = current_stake_value - proceeds.amount;
             rb.rex_balance.amount -= rex.amount;
@@ -926,8 +1185,9 @@ namespace eosiosystem {
     *
     * Checks if user has a scheduled sellrex order that has been filled, completes its processing,
     * and deletes it. Processing entails transfering proceeds to user REX fund and updating user
-    * vote weight. Additional proceeds and stake change can be passed as arguments. This function
-    * is called only by actions pushed by owner.
+    * vote weight. Proceeds of an order that has only been partially filled are delivered the same
+    * way, and the order stays open for the remainder. Additional proceeds and stake change can be
+    * passed as arguments. This function is called only by actions pushed by owner.
     *
     * @param owner - owner account name
     * @param proceeds - additional proceeds to be transfered to owner REX fund
@@ -945,6 +1205,15 @@ namespace eosiosystem {
       if ( itr != _rexorders.end() ) {
          if ( itr->is_open ) {
             rex_in_sell_order.amount = itr->rex_requested.amount;
+            /// deliver the proceeds of a partially filled order, the remainder stays queued
+            if ( itr->proceeds.amount > 0 || itr->stake_change.amount != 0 ) {
+               to_fund.amount  += itr->proceeds.amount;
+               to_stake.amount += itr->stake_change.amount;
+               _rexorders.modify( itr, same_payer, [&]( auto& order ) {
+                  order.proceeds.amount     = 0;
+                  order.stake_change.amount = 0;
+               });
+            }
          } else {
             to_fund.amount  += itr->proceeds.amount;
             to_stake.amount += itr->stake_change.amount;
@@ -982,6 +1251,27 @@ namespace eosiosystem {
 #endif
    }
 
+   /**
+    * @brief Channels system fees to rex_pool balances held by the caller
+    *
+    * @param pool - rex_pool balances to be updated, written back by the caller
+    * @param from - account from which asset is transfered to REX pool
+    * @param amount - amount of tokens to be transfered
+    */
+   void system_contract::channel_to_rex( rex_pool& pool, const name& from, const asset& amount )
+   {
+#if CHANNEL_RAM_AND_NAMEBID_FEES_TO_REX
+      if ( pool.total_rex.amount > 0 ) {
+         pool.total_unlent.amount   += amount.amount;
+         pool.total_lendable.amount += amount.amount;
+         // inline transfer to rex_account
+         token::transfer_action transfer_act{ token_account, { from, active_permission } };
+         transfer_act.send( from, rex_account, amount,
+                            std::string("transfer from ") + from.to_string() + " to eosio.rex" );
+      }
+#endif
+   }
+
    /**
     * @brief Updates namebid proceeds to be transfered to REX pool
     *
@@ -1016,19 +1306,118 @@ namespace eosiosystem {
    /**
     * @brief Updates REX owner maturity buckets
     *
+    * Moves matured buckets into matured_rex. While the fixed-size encoding is on, rows still using
+    * rex_maturities are then migrated to rex_maturity_buckets, unless that would make the row larger.
+    * Savings held aside by read_rex_savings are not counted in that comparison.
+    *
     * @param bitr - iterator pointing to rex_balance object
     */
    void system_contract::process_rex_maturities( const rex_balance_table::const_iterator& bitr )
    {
       const time_point_sec now = current_time_point_sec();
+      const bool migrate = !bitr->maturity_buckets.has_value() && fixed_rex_maturities();
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
+         if ( rb.maturity_buckets.has_value() ) {
+            auto& mb = rb.maturity_buckets.value();
+            const uint32_t today = now.utc_seconds / seconds_per_day;
+            while ( !mb.buckets.empty() && mb.head_day <= today ) {
+               rb.matured_rex += mb.buckets.front();
+               mb.buckets.erase( mb.buckets.begin() );
+               ++mb.head_day;
+            }
+         }
          while ( !rb.rex_maturities.empty() && rb.rex_maturities.front().first <= now ) {
             rb.matured_rex += rb.rex_maturities.front().second;
             rb.rex_maturities.pop_front();
          }
+         if ( migrate ) {
+            rex_maturity_buckets mb;
+            for ( const auto& m : rb.rex_maturities ) {
+               if ( m.first == time_point_sec::maximum() ) {
+                  mb.savings += m.second;
+               } else {
+                  add_to_rex_maturity_buckets( mb, m.first.utc_seconds / seconds_per_day, m.second );
+               }
+            }
+            /// the emptied rex_maturities still takes one byte
+            if ( eosio::pack_size( mb ) + 1 <= eosio::pack_size( rb.rex_maturities ) ) {
+               rb.maturity_buckets.emplace( std::move(mb) );
+               rb.rex_maturities.clear();
+            }
+         }
       });
    }
 
+   /**
+    * @brief Adds REX to the maturity bucket of a given day, in either encoding of the buckets
+    *
+    * @param rb - rex_balance object being modified
+    * @param maturity - maturity time of the bucket, the start of a day
+    * @param rex - amount of REX to be added
+    */
+   void system_contract::add_to_rex_maturity( rex_balance& rb, const time_point_sec& maturity, int64_t rex )
+   {
+      if ( rb.maturity_buckets.has_value() ) {
+         if ( maturity <= current_time_point_sec() ) {
+            rb.matured_rex += rex;
+         } else {
+            add_to_rex_maturity_buckets( rb.maturity_buckets.value(), maturity.utc_seconds / seconds_per_day, rex );
+         }
+      } else if ( !rb.rex_maturities.empty() && rb.rex_maturities.back().first == maturity ) {
+         rb.rex_maturities.back().second += rex;
+      } else {
+         rb.rex_maturities.emplace_back( maturity, rex );
+      }
+   }
+
+   /**
+    * @brief Adds REX to the bucket of a given day in rex_maturity_buckets, widening the kept range of days
+    *
+    * @param mb - maturity buckets being modified
+    * @param day - maturity day of the bucket
+    * @param rex - amount of REX to be added
+    */
+   void system_contract::add_to_rex_maturity_buckets( rex_maturity_buckets& mb, uint32_t day, int64_t rex )
+   {
+      if ( mb.buckets.empty() ) {
+         mb.head_day = day;
+      } else if ( day < mb.head_day ) {
+         check( mb.head_day - day + mb.buckets.size() <= max_rex_maturities, "logic error in REX maturity buckets" );
+         mb.buckets.insert( mb.buckets.begin(), mb.head_day - day, 0 );
+         mb.head_day = day;
+      }
+      const uint32_t i = day - mb.head_day;
+      check( i < max_rex_maturities, "logic error in REX maturity buckets" );
+      if ( mb.buckets.size() <= i ) {
+         mb.buckets.resize( i + 1 );
+      }
+      mb.buckets[i] += rex;
+   }
+
+   /**
+    * @brief Sets whether rex_balance rows are migrated to the fixed-size maturity buckets
+    *
+    * @param fixed_maturities - if true, rows are migrated the next time their maturities are processed,
+    * provided that does not make them larger
+    */
+   void system_contract::setrexenc( bool fixed_maturities )
+   {
+      require_auth( _self );
+
+      rex_encoding_config config;
+      config.fixed_maturities = fixed_maturities;
+      rex_encoding_singleton( _self, _self.value ).set( config, _self );
+      _rexenc = config;
+   }
+
+   bool system_contract::fixed_rex_maturities()
+   {
+      if ( !_rexenc ) {
+         _rexenc = rex_encoding_singleton( _self, _self.value ).get_or_default();
+      }
+      return _rexenc->fixed_maturities;
+   }
+
    /**
     * @brief Consolidates REX maturity buckets into one
     *
@@ -1042,12 +1431,19 @@ namespace eosiosystem {
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
          int64_t total  = rb.matured_rex - rex_in_sell_order.amount;
          rb.matured_rex = rex_in_sell_order.amount;
+         if ( rb.maturity_buckets.has_value() ) {
+            auto& mb = rb.maturity_buckets.value();
+            for ( const auto& bucket : mb.buckets ) {
+               total += bucket;
+            }
+            mb.buckets.clear();
+         }
          while ( !rb.rex_maturities.empty() ) {
             total += rb.rex_maturities.front().second;
             rb.rex_maturities.pop_front();
          }
          if ( total > 0 ) {
-            rb.rex_maturities.emplace_back( get_rex_maturity(), total );
+            add_to_rex_maturity( rb, get_rex_maturity(), total );
          }
       });
       put_rex_savings( bitr, rex_in_savings );
@@ -1097,14 +1493,10 @@ namespace eosiosystem {
       } else {
          /// total_lendable > 0 if total_rex > 0 except in a rare case and due to rounding errors
          check( itr->total_lendable.amount > 0, "lendable REX pool is empty" );
-         const int64_t S0 = itr->total_lendable.amount;
-         const int64_t S1 = S0 + payment.amount;
-         const int64_t R0 = itr->total_rex.amount;
-         const int64_t R1 = (uint128_t(S1) * R0) / S0;
-         rex_received.amount = R1 - R0;
+         rex_received.amount = rex_for_payment( *itr, payment.amount );
          _rexpool.modify( itr, same_payer, [&]( auto& rp ) {
-            rp.total_lendable.amount = S1;
-            rp.total_rex.amount      = R1;
+            rp.total_lendable.amount += payment.amount;
+            rp.total_rex.amount      += rex_received.amount;
             rp.total_unlent.amount   = rp.total_lendable.amount - rp.total_lent.amount;
             check( rp.total_unlent.amount >= 0, "programmer error, this should never go negative" );
          });
@@ -1113,6 +1505,46 @@ namespace eosiosystem {
       return rex_received;
    }
 
+   /**
+    * @brief REX tokens issued for a payment into a REX pool with a positive lendable balance
+    *
+    * @param pool - REX pool
+    * @param payment - amount of core tokens paid
+    *
+    * @return int64_t - amount of REX tokens issued
+    */
+   int64_t system_contract::rex_for_payment( const rex_pool& pool, int64_t payment )
+   {
+      const int64_t S0 = pool.total_lendable.amount;
+      const int64_t R0 = pool.total_rex.amount;
+      return (uint128_t(S0 + payment) * R0) / S0 - R0;
+   }
+
+   /**
+    * @brief Core tokens paid out for REX tokens sold to a REX pool
+    *
+    * @param pool - REX pool
+    * @param rex - amount of REX tokens sold
+    *
+    * @return int64_t - amount of core tokens paid out
+    */
+   int64_t system_contract::rex_proceeds( const rex_pool& pool, int64_t rex )
+   {
+      return (uint128_t(rex) * pool.total_lendable.amount) / pool.total_rex.amount;
+   }
+
+   /**
+    * @brief Sends the result of a quote action as a quoteresult notification
+    *
+    * @param in - amount paid in
+    * @param out - amount received
+    */
+   void system_contract::send_quote( const asset& in, const asset& out )
+   {
+      rex_results::quoteresult_action quote_act{ rex_account, std::vector<eosio::permission_level>{ } };
+      quote_act.send( in, out );
+   }
+
    /**
     * @brief Updates owner REX balance upon buying REX tokens
     *
@@ -1147,12 +1579,7 @@ namespace eosiosystem {
       const int64_t rex_in_savings = read_rex_savings( bitr );
       process_rex_maturities( bitr );
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
-         const time_point_sec maturity = get_rex_maturity();
-         if ( !rb.rex_maturities.empty() && rb.rex_maturities.back().first == maturity ) {
-            rb.rex_maturities.back().second += rex_received.amount;
-         } else {
-            rb.rex_maturities.emplace_back( maturity, rex_received.amount );
-         }
+         add_to_rex_maturity( rb, get_rex_maturity(), rex_received.amount );
       });
       put_rex_savings( bitr, rex_in_savings );
       return current_rex_stake - init_rex_stake;
@@ -1163,7 +1590,8 @@ namespace eosiosystem {
     *
     * Reads and (temporarily) removes REX savings bucket from REX maturities in order to
     * allow uniform processing of remaining buckets as savings is a special case. This 
-    * function is used in conjunction with put_rex_savings.
+    * function is used in conjunction with put_rex_savings. Rows using rex_maturity_buckets
+    * keep savings in a separate field, which is read as is and overwritten by put_rex_savings.
     *
     * @param bitr - iterator pointing to rex_balance object
     *
@@ -1171,6 +1599,9 @@ namespace eosiosystem {
     */
    int64_t system_contract::read_rex_savings( const rex_balance_table::const_iterator& bitr )
    {
+      if ( bitr->maturity_buckets.has_value() ) {
+         return bitr->maturity_buckets.value().savings;
+      }
       int64_t rex_in_savings = 0;
       static const time_point_sec end_of_days = time_point_sec::maximum();
       if ( !bitr->rex_maturities.empty() && bitr->rex_maturities.back().first == end_of_days ) {
@@ -1190,6 +1621,14 @@ namespace eosiosystem {
     */
    void system_contract::put_rex_savings( const rex_balance_table::const_iterator& bitr, int64_t rex )
    {
+      if ( bitr->maturity_buckets.has_value() ) {
+         if ( bitr->maturity_buckets.value().savings != rex ) {
+            _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
+               rb.maturity_buckets.value().savings = rex;
+            });
+         }
+         return;
+      }
       if ( rex == 0 ) return;
       static const time_point_sec end_of_days = time_point_sec::maximum();
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
@@ -8,4 +8,6 @@ void rex_results::orderresult( const name& owner, const asset& proceeds ) { }
 
 void rex_results::rentresult( const asset& rented_tokens ) { }
 
+void rex_results::quoteresult( const asset& in, const asset& out ) { }
+
 extern "C" void apply( uint64_t, uint64_t, uint64_t ) { }
@@ -48,6 +48,7 @@ namespace eosiosystem {
             if ( info.last_claim_time == time_point() )
                info.last_claim_time = ct;
          });
+         invalidate_elected_set(); /// the key or the activation may have changed
 
          auto prod2 = _producers2.find( producer.value );
          if ( prod2 == _producers2.end() ) {
@@ -83,27 +84,92 @@ namespace eosiosystem {
       _producers.modify( prod, same_payer, [&]( producer_info& info ){
          info.deactivate();
       });
+      invalidate_elected_set();
+   }
+
+   elected_set& system_contract::elected() {
+      if( !_elected ) {
+         _elected = _electedset.get_or_default();
+      }
+      return *_elected;
+   }
+
+   /**
+    *  Called after the votes of `prod` changed; marks the elected set dirty only when the change may
+    *  move `prod` across the top-N boundary, otherwise just widens the stored bounds.
+    */
+   void system_contract::update_elected_set( const producer_info& prod ) {
+      auto& es = elected();
+      if( es.dirty )
+         return;
+
+      if( std::binary_search( es.producers.begin(), es.producers.end(), prod.owner ) ) {
+         if( prod.total_votes <= es.runner_up ) {
+            es.dirty = true;
+         } else if( prod.total_votes < es.threshold ) {
+            es.threshold = prod.total_votes;
+         } else {
+            return;
+         }
+      } else if( prod.active() ) {
+         if( 0 < prod.total_votes && es.threshold <= prod.total_votes ) {
+            es.dirty = true;
+         } else if( es.runner_up < prod.total_votes ) {
+            es.runner_up = prod.total_votes;
+         } else {
+            return;
+         }
+      } else {
+         return;
+      }
+      _elected_dirty = true;
+   }
+
+   void system_contract::invalidate_elected_set() {
+      auto& es = elected();
+      if( !es.dirty ) {
+         es.dirty = true;
+         _elected_dirty = true;
+      }
    }
 
    void system_contract::update_elected_producers( block_timestamp block_time ) {
-      _gstate.last_producer_schedule_update = block_time;
+      block_stats().last_producer_schedule_update = block_time;
+      _gblock_dirty = true;
+
+      auto& es = elected();
+      if( !es.dirty ) {
+         return;
+      }
 
       auto idx = _producers.get_index<"prototalvote"_n>();
 
       std::vector< std::pair<eosio::producer_key,uint16_t> > top_producers;
       top_producers.reserve(_gstate.max_producer_schedule_size);
 
-      for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < _gstate.max_producer_schedule_size && 0 < it->total_votes && it->active(); ++it ) {
+      double lowest_votes = 0;
+      auto it = idx.cbegin();
+      for ( ; it != idx.cend() && top_producers.size() < _gstate.max_producer_schedule_size && 0 < it->total_votes && it->active(); ++it ) {
          top_producers.emplace_back( std::pair<eosio::producer_key,uint16_t>({{it->owner, it->producer_key}, it->location}) );
+         lowest_votes = it->total_votes;
       }
 
+      /// sort by producer name
+      std::sort( top_producers.begin(), top_producers.end() );
+
+      es.producers.clear();
+      es.producers.reserve(top_producers.size());
+      for( const auto& item : top_producers )
+         es.producers.push_back(item.first.producer_name);
+      es.threshold = top_producers.size() < _gstate.max_producer_schedule_size ? 0 : lowest_votes;
+      es.runner_up = ( it != idx.cend() && 0 < it->total_votes && it->active() ) ? it->total_votes : 0;
+      es.dirty     = false;
+      _elected_dirty = true;
+
       if ( top_producers.size() < _gstate.last_producer_schedule_size ) {
          return;
       }
 
-      /// sort by producer name
-      std::sort( top_producers.begin(), top_producers.end() );
-
       std::vector<eosio::producer_key> producers;
 
       producers.reserve(top_producers.size());
@@ -112,15 +178,32 @@ namespace eosiosystem {
 
       auto packed_schedule = pack(producers);
 
+      capi_checksum256 digest;
+      sha256( packed_schedule.data(), packed_schedule.size(), &digest );
+      if( std::equal( std::begin(digest.hash), std::end(digest.hash), std::begin(es.digest.hash) ) ) {
+         return;
+      }
+
+      /// -1 means the schedule equals the active or pending one, e.g. right after the upgrade while `es.digest` is empty
       if( set_proposed_producers( packed_schedule.data(),  packed_schedule.size() ) >= 0 ) {
          _gstate.last_producer_schedule_size = static_cast<decltype(_gstate.last_producer_schedule_size)>( top_producers.size() );
+         _gstate_dirty = true;
       }
+      es.digest = digest;
    }
 
-   double stake2vote( int64_t staked ) {
+   double system_contract::stake2vote( int64_t staked ) {
       /// TODO subtract 2080 brings the large numbers closer to this decade
-      double weight = int64_t( (now() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) )  / double( 52 );
-      return double(staked) * std::pow( 2, weight );
+      const int64_t week = int64_t( (now() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) );
+      if( !_vweight ) {
+         _vweight = _voteweight.get_or_default();
+      }
+      if( _vweight->week != week ) {
+         _vweight->week       = static_cast<uint32_t>( week );
+         _vweight->multiplier = std::pow( 2, week / double( 52 ) );
+         _voteweight.set( *_vweight, _self );
+      }
+      return double(staked) * _vweight->multiplier;
    }
 
    double system_contract::update_total_votepay_share( time_point ct,
@@ -147,6 +230,7 @@ namespace eosiosystem {
       }
 
       _gstate3.last_vpay_state_update = ct;
+      _gstate2_dirty = _gstate3_dirty = true;
 
       return _gstate2.total_producer_votepay_share;
    }
@@ -155,25 +239,71 @@ namespace eosiosystem {
                                                           time_point ct,
                                                           double shares_rate,
                                                           bool reset_to_zero )
+   {
+      double new_votepay_share = 0.0;
+      _producers2.modify( prod_itr, same_payer, [&](auto& p) {
+         new_votepay_share = update_producer_votepay_share( p, ct, shares_rate, reset_to_zero );
+      } );
+
+      return new_votepay_share;
+   }
+
+   double system_contract::update_producer_votepay_share( producer_info2& info,
+                                                          time_point ct,
+                                                          double shares_rate,
+                                                          bool reset_to_zero )
    {
       double delta_votepay_share = 0.0;
-      if( shares_rate > 0.0 && ct > prod_itr->last_votepay_share_update ) {
-         delta_votepay_share = shares_rate * double( (ct - prod_itr->last_votepay_share_update).count() / 1E6 ); // cannot be negative
+      if( shares_rate > 0.0 && ct > info.last_votepay_share_update ) {
+         delta_votepay_share = shares_rate * double( (ct - info.last_votepay_share_update).count() / 1E6 ); // cannot be negative
       }
 
-      double new_votepay_share = prod_itr->votepay_share + delta_votepay_share;
-      _producers2.modify( prod_itr, same_payer, [&](auto& p) {
-         if( reset_to_zero )
-            p.votepay_share = 0.0;
-         else
-            p.votepay_share = new_votepay_share;
+      double new_votepay_share = info.votepay_share + delta_votepay_share;
+      if( reset_to_zero )
+         info.votepay_share = 0.0;
+      else
+         info.votepay_share = new_votepay_share;
 
-         p.last_votepay_share_update = ct;
-      } );
+      info.last_votepay_share_update = ct;
 
       return new_votepay_share;
    }
 
+   system_contract::producer_cache_entry* system_contract::cached_producer( const name& owner ) {
+      for( auto& pc : _prodcache ) {
+         if( pc.info.owner == owner )
+            return &pc;
+      }
+      auto pitr = _producers.find( owner.value );
+      if( pitr == _producers.end() )
+         return nullptr;
+
+      auto& pc = _prodcache.emplace_back();
+      pc.itr  = pitr;
+      pc.info = *pitr;
+      pc.itr2 = _producers2.find( owner.value );
+      if( pc.itr2 != _producers2.end() )
+         pc.info2 = *pc.itr2;
+      return &pc;
+   }
+
+   void system_contract::flush_producer_cache() {
+      for( const auto& pc : _prodcache ) {
+         if( pc.dirty ) {
+            _producers.modify( pc.itr, same_payer, [&]( auto& p ) {
+               p = pc.info;
+            });
+            update_elected_set( pc.info );
+         }
+         if( pc.dirty2 ) {
+            _producers2.modify( pc.itr2, same_payer, [&]( auto& p ) {
+               p = pc.info2;
+            });
+         }
+      }
+      _prodcache.clear();
+   }
+
    /**
     *  @pre producers must be sorted from lowest to highest and must be registered and active
     *  @pre if proxy is set then no producers can be voted for
@@ -223,6 +353,7 @@ namespace eosiosystem {
        */
       if( voter->last_vote_weight <= 0.0 ) {
          _gstate.total_activated_stake += voter->staked;
+         _gstate_dirty = true;
          if( _gstate.total_activated_stake >= _gstate.min_activated_stake && I64_TO_TIME(_gstate.thresh_activated_stake_time) == time_point() ) {
             _gstate.thresh_activated_stake_time = TIME_TO_I64(current_time_point());
          }
@@ -242,9 +373,11 @@ namespace eosiosystem {
                   vp.proxied_vote_weight -= voter->last_vote_weight;
 //                  vp.last_change_time = current_time_point();
                });
-            propagate_weight_change( *old_proxy );
+            /// a proxy that gets the new weight back below is settled once, with the net change
+            if( !(proxy == voter->proxy && lazy_proxy_propagation()) && !defer_proxy_propagation( *old_proxy ) )
+               propagate_weight_change( *old_proxy );
          } else {
-            for( const auto& p : voter->producers ) {
+            for( const auto& p : voted_producers( *voter ) ) {
                auto& d = producer_deltas[p];
                d.first -= voter->last_vote_weight;
                d.second = false;
@@ -261,7 +394,8 @@ namespace eosiosystem {
                   vp.proxied_vote_weight += new_vote_weight;
                 //  vp.last_change_time = current_time_point();
                });
-            propagate_weight_change( *new_proxy );
+            if( !defer_proxy_propagation( *new_proxy ) )
+               propagate_weight_change( *new_proxy );
          }
       } else {
          if( new_vote_weight >= 0 ) {
@@ -277,30 +411,31 @@ namespace eosiosystem {
       double delta_change_rate         = 0.0;
       double total_inactive_vpay_share = 0.0;
       for( const auto& pd : producer_deltas ) {
-         auto pitr = _producers.find( pd.first.value );
-         if( pitr != _producers.end() ) {
-            check( !voting || pitr->active() || !pd.second.second /* not from new set */, "producer is not currently registered" );
-            double init_total_votes = pitr->total_votes;
-            _producers.modify( pitr, same_payer, [&]( auto& p ) {
-               p.total_votes += pd.second.first;
-               if ( p.total_votes < 0 ) { // floating point arithmetics can give small negative numbers
-                  p.total_votes = 0;
-               }
-               _gstate.total_producer_vote_weight += pd.second.first;
-               //check( p.total_votes >= 0, "something bad happened" );
-            });
-            auto prod2 = _producers2.find( pd.first.value );
-            if( prod2 != _producers2.end() ) {
-               const auto last_claim_plus_3days = pitr->last_claim_time + microseconds(3 * _gstate.useconds_per_day);
+         auto pc = cached_producer( pd.first );
+         if( pc ) {
+            auto& prod = pc->info;
+            check( !voting || prod.active() || !pd.second.second /* not from new set */, "producer is not currently registered" );
+            double init_total_votes = prod.total_votes;
+            prod.total_votes += pd.second.first;
+            if ( prod.total_votes < 0 ) { // floating point arithmetics can give small negative numbers
+               prod.total_votes = 0;
+            }
+            pc->dirty = true;
+            _gstate.total_producer_vote_weight += pd.second.first;
+            _gstate_dirty = true;
+            //check( prod.total_votes >= 0, "something bad happened" );
+            if( pc->itr2 != _producers2.end() ) {
+               const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * _gstate.useconds_per_day);
                bool crossed_threshold       = (last_claim_plus_3days <= ct);
-               bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
+               bool updated_after_threshold = (last_claim_plus_3days <= pc->info2.last_votepay_share_update);
                // Note: updated_after_threshold implies cross_threshold
 
-               double new_votepay_share = update_producer_votepay_share( prod2,
+               double new_votepay_share = update_producer_votepay_share( pc->info2,
                                              ct,
                                              updated_after_threshold ? 0.0 : init_total_votes,
                                              crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
                                           );
+               pc->dirty2 = true;
 
                if( !crossed_threshold ) {
                   delta_change_rate += pd.second.first;
@@ -316,12 +451,25 @@ namespace eosiosystem {
 
       update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
 
+      if( _gstate.to_voter_bonus_rate > 0 ) {
+         /// settle what the old weight earned before the weight, the producers or the proxy change
+         const double bonus_per_vote = voter_bonus_per_vote( *voter );
+         double next_bonus_per_vote = fold_voter_bonus( *voter, voted_producers( *voter ), proxy ? std::vector<name>() : producers );
+         if( proxy ) {
+            const auto& new_proxy = _voters.get( proxy.value );
+            next_bonus_per_vote = accumulated_bonus_per_vote( proxy, voted_producers( new_proxy ) );
+         }
+         settle_voter_bonus( *voter, bonus_per_vote, next_bonus_per_vote, stake2vote( voter->staked ) );
+      }
+
       _voters.modify( voter, same_payer, [&]( auto& av ) {
          av.last_vote_weight = new_vote_weight;
-         av.producers = producers;
+         set_voted_producers( av, producers );
          av.proxy     = proxy;
         // av.last_change_time = ct;
       });
+      /// the producers touched here and by any proxy cascade above are written back once
+      flush_producer_cache();
    }
 
    /**
@@ -345,6 +493,7 @@ namespace eosiosystem {
             //   p.last_change_time = current_time_point();
             });
          propagate_weight_change( *pitr );
+         flush_producer_cache();
       } else {
          _voters.emplace( proxy, [&]( auto& p ) {
                p.owner  = proxy;
@@ -354,6 +503,264 @@ namespace eosiosystem {
       }
    }
 
+   /// the weight a voter earns bonus with, i.e. without the weight proxied to it
+   static double own_vote_weight( const voter_info& voter ) {
+      const double weight = voter.last_vote_weight - ( voter.is_proxy ? voter.proxied_vote_weight : 0 );
+      return weight > 0 ? weight : 0;
+   }
+
+   /**
+    *  The cumulative bonus per vote earned by voting directly for `producers`, see `voter_bonus_account`.
+    */
+   double system_contract::accumulated_bonus_per_vote( const name& owner, const std::vector<name>& producers ) {
+      voter_bonus_account_table accounts( _self, _self.value );
+      auto aitr = accounts.find( owner.value );
+      double bonus_per_vote = aitr != accounts.end() ? aitr->bonus_per_vote : 0;
+
+      producer_bonus_table       bonus( _self, _self.value );
+      voter_bonus_snapshot_table snapshots( _self, owner.value );
+      for( const auto& p : producers ) {
+         auto bitr = bonus.find( p.value );
+         if( bitr == bonus.end() )
+            continue;
+         auto sitr = snapshots.find( p.value );
+         bonus_per_vote += bitr->bonus_per_vote - ( sitr != snapshots.end() ? sitr->bonus_per_vote : 0 );
+      }
+      return bonus_per_vote;
+   }
+
+   double system_contract::voter_bonus_per_vote( const voter_info& voter ) {
+      if( voter.proxy ) {
+         const auto& proxy = _voters.get( voter.proxy.value, "proxy not found" ); //data corruption
+         return accumulated_bonus_per_vote( proxy.owner, voted_producers( proxy ) );
+      }
+      return accumulated_bonus_per_vote( voter.owner, voted_producers( voter ) );
+   }
+
+   /**
+    *  Folds the growth of `old_producers` into the voter's accumulated bonus per vote and snapshots
+    *  `new_producers`, so that the accumulated value carries on without a jump. Returns that value.
+    */
+   double system_contract::fold_voter_bonus( const voter_info& voter, const std::vector<name>& old_producers,
+                                             const std::vector<name>& new_producers ) {
+      const double bonus_per_vote = accumulated_bonus_per_vote( voter.owner, old_producers );
+      if( old_producers == new_producers )
+         return bonus_per_vote;
+
+      const name payer = has_auth( voter.owner ) ? voter.owner : _self;
+      voter_bonus_snapshot_table snapshots( _self, voter.owner.value );
+      for( const auto& p : old_producers ) {
+         if( std::binary_search( new_producers.begin(), new_producers.end(), p ) )
+            continue;
+         auto sitr = snapshots.find( p.value );
+         if( sitr != snapshots.end() )
+            snapshots.erase( sitr );
+      }
+
+      producer_bonus_table bonus( _self, _self.value );
+      for( const auto& p : new_producers ) {
+         auto bitr = bonus.find( p.value );
+         if( bitr == bonus.end() )
+            continue;
+         auto sitr = snapshots.find( p.value );
+         if( sitr == snapshots.end() ) {
+            snapshots.emplace( payer, [&]( auto& sn ) {
+               sn.producer       = p;
+               sn.bonus_per_vote = bitr->bonus_per_vote;
+            });
+         } else {
+            snapshots.modify( sitr, same_payer, [&]( auto& sn ) {
+               sn.bonus_per_vote = bitr->bonus_per_vote;
+            });
+         }
+      }
+
+      voter_bonus_account_table accounts( _self, _self.value );
+      auto aitr = accounts.find( voter.owner.value );
+      if( aitr == accounts.end() ) {
+         accounts.emplace( payer, [&]( auto& a ) {
+            a.owner          = voter.owner;
+            a.bonus_per_vote = bonus_per_vote;
+            a.weight         = own_vote_weight( voter );
+         });
+      } else {
+         accounts.modify( aitr, same_payer, [&]( auto& a ) {
+            a.bonus_per_vote = bonus_per_vote;
+         });
+      }
+      return bonus_per_vote;
+   }
+
+   /**
+    *  Adds what the voter's settled weight earned up to `bonus_per_vote` to its owed bonus, and settles it at
+    *  `next_bonus_per_vote` with `next_weight` from now on. A claim keeps the weight and takes the owed bonus.
+    */
+   int64_t system_contract::settle_voter_bonus( const voter_info& voter, double bonus_per_vote, double next_bonus_per_vote,
+                                                double next_weight, bool claim ) {
+      voter_bonus_account_table accounts( _self, _self.value );
+      auto aitr = accounts.find( voter.owner.value );
+      voter_bonus_account acnt;
+      if( aitr != accounts.end() ) {
+         acnt = *aitr;
+      } else {
+         acnt.owner  = voter.owner;
+         acnt.weight = own_vote_weight( voter );
+      }
+
+      const auto delta = static_cast<int64_t>( acnt.weight * ( bonus_per_vote - acnt.snapshot ) );
+      if( delta > 0 )
+         acnt.owed += delta;
+      acnt.snapshot = next_bonus_per_vote;
+
+      int64_t amount = 0;
+      if( claim ) {
+         amount    = acnt.owed;
+         acnt.owed = 0;
+      } else {
+         acnt.weight = next_weight;
+      }
+
+      if( aitr == accounts.end() ) {
+         accounts.emplace( has_auth( voter.owner ) ? voter.owner : _self, [&]( auto& a ) {
+            a = acnt;
+         });
+      } else {
+         accounts.modify( aitr, same_payer, [&]( auto& a ) {
+            a = acnt;
+         });
+      }
+      return amount;
+   }
+
+   void system_contract::setvoteenc( bool compact ) {
+      require_auth( _self );
+
+      vote_encoding_config config;
+      config.compact = compact;
+      vote_encoding_singleton( _self, _self.value ).set( config, _self );
+   }
+
+   bool system_contract::compact_votes() {
+      if( !_voteenc ) {
+         _voteenc = vote_encoding_singleton( _self, _self.value ).get_or_default();
+      }
+      return _voteenc->compact;
+   }
+
+   uint16_t system_contract::producer_id( const name& owner ) {
+      producer_id_table ids( _self, _self.value );
+      auto idx = ids.get_index<"byowner"_n>();
+      auto itr = idx.find( owner.value );
+      if( itr != idx.end() )
+         return static_cast<uint16_t>( itr->id );
+
+      const uint64_t id = ids.available_primary_key();
+      check( id <= std::numeric_limits<uint16_t>::max(), "producer id space is exhausted" );
+      ids.emplace( _self, [&]( auto& p ) {
+         p.id    = id;
+         p.owner = owner;
+      });
+      if( _prodnames.size() <= id )
+         _prodnames.resize( id + 1 );
+      _prodnames[id] = owner;
+      return static_cast<uint16_t>( id );
+   }
+
+   /**
+    *  The producers a voter votes for, whichever encoding its row uses. Ids are decoded through
+    *  `_prodnames`, so each `prodreg` row is read at most once per action.
+    */
+   std::vector<name> system_contract::voted_producers( const voter_info& voter ) {
+      if( !voter.producer_ids.has_value() || voter.producer_ids.value().empty() )
+         return voter.producers;
+
+      producer_id_table ids( _self, _self.value );
+      std::vector<name> producers;
+      producers.reserve( voter.producer_ids.value().size() );
+      for( auto id : voter.producer_ids.value() ) {
+         if( _prodnames.size() <= id )
+            _prodnames.resize( id + 1 );
+         if( !_prodnames[id] )
+            _prodnames[id] = ids.get( id, "producer id not found" ).owner; //data corruption
+         producers.push_back( _prodnames[id] );
+      }
+      return producers;
+   }
+
+   void system_contract::set_voted_producers( voter_info& voter, const std::vector<name>& producers ) {
+      if( compact_votes() ) {
+         std::vector<uint16_t> ids;
+         ids.reserve( producers.size() );
+         for( const auto& p : producers ) {
+            ids.push_back( producer_id( p ) );
+         }
+         voter.producers.clear();
+         voter.producer_ids.emplace( std::move(ids) );
+      } else {
+         voter.producers = producers;
+         if( voter.producer_ids.has_value() )
+            voter.producer_ids.reset();
+      }
+   }
+
+   void system_contract::setproxyprop( bool lazy, double threshold ) {
+      require_auth( _self );
+      check( threshold >= 0, "threshold must be non-negative" );
+
+      proxy_propagation_config config;
+      config.lazy      = lazy;
+      config.threshold = threshold;
+      proxy_propagation_singleton( _self, _self.value ).set( config, _self );
+   }
+
+   void system_contract::propproxies( uint16_t max ) {
+      check( max > 0, "max must be positive" );
+
+      pending_proxy_table pending( _self, _self.value );
+      check( pending.begin() != pending.end(), "no pending proxies" );
+      for( auto itr = pending.begin(); itr != pending.end() && max > 0; --max ) {
+         auto proxy = _voters.find( itr->proxy.value );
+         if( proxy != _voters.end() ) {
+            propagate_weight_change( *proxy );
+         }
+         itr = pending.erase( itr );
+      }
+      flush_producer_cache();
+   }
+
+   /**
+    *  With lazy proxy propagation on, records `proxy` as pending instead of updating its producers,
+    *  unless the difference between its current and its last applied weight exceeds the threshold.
+    *  The pending weight needs no extra state: it is that same difference, settled by the next
+    *  propagate_weight_change or vote of the proxy.
+    */
+   bool system_contract::lazy_proxy_propagation() {
+      if( !_proxyprop ) {
+         _proxyprop = proxy_propagation_singleton( _self, _self.value ).get_or_default();
+      }
+      return _proxyprop->lazy;
+   }
+
+   bool system_contract::defer_proxy_propagation( const voter_info& proxy ) {
+      if( !lazy_proxy_propagation() )
+         return false;
+
+      double new_weight = stake2vote( proxy.staked );
+      if ( proxy.is_proxy ) {
+         new_weight += proxy.proxied_vote_weight;
+      }
+      if( fabs( new_weight - proxy.last_vote_weight ) > _proxyprop->threshold )
+         return false;
+
+      pending_proxy_table pending( _self, _self.value );
+      if( pending.find( proxy.owner.value ) == pending.end() ) {
+         pending.emplace( _self, [&]( auto& p ) {
+            p.proxy = proxy.owner;
+         });
+      }
+      return true;
+   }
+
    void system_contract::propagate_weight_change( const voter_info& voter ) {
       check( !voter.proxy || !voter.is_proxy, "account registered as a proxy is not allowed to use a proxy" );
       double new_weight = stake2vote( voter.staked );
@@ -363,6 +770,10 @@ namespace eosiosystem {
 
       /// don't propagate small changes (1 ~= epsilon)
       if ( fabs( new_weight - voter.last_vote_weight ) > 1 )  {
+         if( _gstate.to_voter_bonus_rate > 0 ) {
+            const double bonus_per_vote = voter_bonus_per_vote( voter );
+            settle_voter_bonus( voter, bonus_per_vote, bonus_per_vote, stake2vote( voter.staked ) );
+         }
          if ( voter.proxy ) {
             auto& proxy = _voters.get( voter.proxy.value, "proxy not found" ); //data corruption
             _voters.modify( proxy, same_payer, [&]( auto& p ) {
@@ -370,31 +781,34 @@ namespace eosiosystem {
              //     p.last_change_time = current_time_point();
                }
             );
-            propagate_weight_change( proxy );
+            if( !defer_proxy_propagation( proxy ) )
+               propagate_weight_change( proxy );
          } else {
             auto delta = new_weight - voter.last_vote_weight;
             const auto ct = current_time_point();
             double delta_change_rate         = 0;
             double total_inactive_vpay_share = 0;
-            for ( auto acnt : voter.producers ) {
-               auto& prod = _producers.get( acnt.value, "producer not found" ); //data corruption
+            for ( auto acnt : voted_producers( voter ) ) {
+               auto pc = cached_producer( acnt );
+               check( pc != nullptr, "producer not found" ); //data corruption
+               auto& prod = pc->info;
                const double init_total_votes = prod.total_votes;
-               _producers.modify( prod, same_payer, [&]( auto& p ) {
-                  p.total_votes += delta;
-                  _gstate.total_producer_vote_weight += delta;
-               });
-               auto prod2 = _producers2.find( acnt.value );
-               if ( prod2 != _producers2.end() ) {
+               prod.total_votes += delta;
+               pc->dirty = true;
+               _gstate.total_producer_vote_weight += delta;
+               _gstate_dirty = true;
+               if ( pc->itr2 != _producers2.end() ) {
                   const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * _gstate.useconds_per_day);
                   bool crossed_threshold       = (last_claim_plus_3days <= ct);
-                  bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
+                  bool updated_after_threshold = (last_claim_plus_3days <= pc->info2.last_votepay_share_update);
                   // Note: updated_after_threshold implies cross_threshold
 
-                  double new_votepay_share = update_producer_votepay_share( prod2,
+                  double new_votepay_share = update_producer_votepay_share( pc->info2,
                                                 ct,
                                                 updated_after_threshold ? 0.0 : init_total_votes,
                                                 crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
                                              );
+                  pc->dirty2 = true;
 
                   if( !crossed_threshold ) {
                      delta_change_rate += delta;
@@ -410,6 +824,9 @@ namespace eosiosystem {
       }
       _voters.modify( voter, same_payer, [&]( auto& v ) {
             v.last_vote_weight = new_weight;
+            if( !v.producers.empty() && compact_votes() ) {
+               set_voted_producers( v, std::vector<name>( v.producers ) );
+            }
             //v.last_change_time = current_time_point();
          }
       );
@@ -7,9 +7,14 @@
 
 namespace icp {
 
-   token::token(name s, name code, datastream<const char*> ds) : contract(s, code, ds) {
-      co_singleton co(_self, _self.value);
-      _co = co.get_or_default(collaborative_contract{});
+   token::token(name s, name code, datastream<const char*> ds) : contract(s, code, ds) {}
+
+   const token::collaborative_contract& token::co() {
+      if (!_co) {
+         co_singleton co(_self, _self.value);
+         _co = co.get_or_default(collaborative_contract{});
+      }
+      return *_co;
    }
 
    void token::setcontracts(name icp, name peer) {
@@ -37,28 +42,189 @@ namespace icp {
       uint8_t       refund;
    };
 
-   void token::icp_transfer(name contract, name from, name icp_to, asset quantity, string memo, uint32_t expiration, bool refund) {
-      check(bool(_co.peer), "empty remote peer contract");
-      check(bool(_co.icp), "empty local icp contract");
+   struct icp_netting_args {
+      name  contract;
+      vector<icp_credit> credits;
+      asset         total;
+      uint8_t       refund;
+   };
+
+   void token::icp_transfer(name contract, name from, name icp_to, asset quantity, std::string_view memo, uint32_t expiration, bool refund) {
+      check(bool(co().peer), "empty remote peer contract");
+      check(bool(co().icp), "empty local icp contract");
 
-      auto seq = eosio::next_packet_seq(_co.icp);
+      if (nets(memo)) {
+         queue_netting(contract, from, icp_to, quantity, expiration, refund);
+         return;
+      }
 
-      auto icp_send = action(vector<permission_level>{}, _co.peer, "icpreceive"_n,
-                             icp_transfer_args{contract, from, icp_to, quantity, memo, refund});
-      auto icp_receive = action(vector<permission_level>{}, _self, "icpreceipt"_n, false); // here action data won't be used
+      auto seq = eosio::next_packet_seq(co().icp);
 
-      locked l(_self, _self.value);
+      auto icp_send = action(vector<permission_level>{}, co().peer, "icpreceive"_n,
+                             icp_transfer_args{contract, from, icp_to, quantity, string(memo), refund});
+
+      locks l(_self, _self.value);
       l.emplace(from, [&](auto& o) {
          o.seq = seq;
          o.contract = contract;
          o.account = from;
          o.balance = quantity;
          o.refund = refund;
+         o.expiration = expiration;
       });
 
+      send_packet(seq, icp_send, expiration);
+   }
+
+   void token::send_packet(uint64_t seq, const action& icp_send, uint32_t expiration) {
+      auto icp_receive = action(vector<permission_level>{}, _self, "icpreceipt"_n, false); // here action data won't be used
+
       auto send_action = pack(icp_send);
       auto receive_action = pack(icp_receive);
-      action(permission_level{_co.icp, "sendaction"_n}, _co.icp, "sendaction"_n, icp_sendaction{seq, send_action, expiration, receive_action}).send(); // TODO: permission
+      action(permission_level{co().icp, "sendaction"_n}, co().icp, "sendaction"_n, icp_sendaction{seq, send_action, expiration, receive_action}).send(); // TODO: permission
+   }
+
+   const token::netting_config& token::netting() {
+      if (!_netting) {
+         netting_singleton ns(_self, _self.value);
+         _netting = ns.get_or_default(netting_config{});
+      }
+      return *_netting;
+   }
+
+   bool token::nets(std::string_view memo) {
+      return netting().window > 0 && memo.empty(); // NB: memos are not carried by netted packets, so such transfers go alone
+   }
+
+   bool token::netting_due(const netting_window& w) {
+      const auto& cfg = netting();
+      if (cfg.window == 0) { // netting disabled, flush whatever remains
+         return true;
+      }
+      auto n = now();
+      return w.credits.size() >= cfg.max_entries || n >= w.opened + cfg.window || w.expiration <= n + cfg.window;
+   }
+
+   void token::queue_netting(name contract, name from, name icp_to, asset quantity, uint32_t expiration, bool refund) {
+      check(bool(icp_to), "empty icp to account");
+      check(expiration > now(), "icp transfer already expired");
+
+      netting_windows ws(_self, _self.value);
+      auto by_contract_asset = ws.get_index<"contractasset"_n>();
+      auto it = by_contract_asset.find(netting_key(contract, quantity, refund));
+      if (it != by_contract_asset.end() && it->expiration <= now()) { // never sent, so give it back before opening a new one
+         cancel_netting(*it);
+         it = by_contract_asset.end();
+      }
+      if (it == by_contract_asset.end()) {
+         // NB: Must set payer to self, since it may be queued during notify
+         ws.emplace(_self, [&](auto& w) {
+            w.pk = ws.available_primary_key();
+            w.contract = contract;
+            w.total = quantity;
+            w.refund = refund;
+            w.opened = now();
+            w.expiration = expiration;
+            w.credits.push_back(icp_credit{from, icp_to, quantity});
+         });
+         it = by_contract_asset.find(netting_key(contract, quantity, refund));
+      } else {
+         check(it->total.symbol == quantity.symbol, "symbol precision mismatch");
+         by_contract_asset.modify(it, same_payer, [&](auto& w) {
+            w.total += quantity;
+            w.expiration = std::min(w.expiration, expiration);
+            w.credits.push_back(icp_credit{from, icp_to, quantity});
+         });
+      }
+
+      if (netting_due(*it)) {
+         flush_netting(*it);
+      }
+   }
+
+   void token::flush_netting(const netting_window& w) {
+      if (w.refund) { // supply of netted refunds is settled once per window, see `icprefund`
+         sub_supply(w.contract, w.total);
+      }
+
+      auto seq = eosio::next_packet_seq(co().icp);
+
+      auto icp_send = action(vector<permission_level>{}, co().peer, "icprecvnet"_n,
+                             icp_netting_args{w.contract, w.credits, w.total, w.refund});
+
+      locks l(_self, _self.value);
+      l.emplace(_self, [&](auto& o) {
+         o.seq = seq;
+         o.contract = w.contract;
+         o.account = _self; // the window, see `netted_credits`
+         o.balance = w.total;
+         o.refund = w.refund;
+         o.expiration = w.expiration;
+      });
+
+      netted nl(_self, _self.value);
+      nl.emplace(_self, [&](auto& o) {
+         o.seq = seq;
+         o.credits = w.credits;
+      });
+
+      send_packet(seq, icp_send, w.expiration);
+
+      netting_windows ws(_self, _self.value);
+      ws.erase(ws.get(w.pk));
+   }
+
+   void token::cancel_netting(const netting_window& w) {
+      for (const auto& c: w.credits) {
+         if (!w.refund) {
+            release_locked(w.contract, c.from, c.quantity, false);
+         } else { // burnt without updating supply, see `icprefund`
+            require_recipient(c.from);
+            add_balance(w.contract, c.from, c.quantity, _self);
+         }
+      }
+
+      netting_windows ws(_self, _self.value);
+      ws.erase(ws.get(w.pk));
+   }
+
+   void token::setnetting(uint32_t window, uint32_t max_entries) {
+      require_auth(_self);
+
+      check(window == 0 || max_entries > 0, "max entries must be positive");
+
+      netting_singleton ns(_self, _self.value);
+      ns.set(netting_config{window, max_entries}, _self);
+      _netting = netting_config{window, max_entries};
+   }
+
+   void token::flushnet(name contract, symbol sym, uint8_t refund) {
+      netting_windows ws(_self, _self.value);
+      auto by_contract_asset = ws.get_index<"contractasset"_n>();
+      const auto& w = by_contract_asset.get(netting_key(contract, asset(0, sym), refund), "no netting window found");
+      if (w.expiration <= now()) { // the packet would be rejected, so never send it
+         cancel_netting(w);
+         return;
+      }
+      check(has_auth(_self) || netting_due(w), "netting window is not due yet");
+
+      flush_netting(w);
+   }
+
+   void token::claimnet(name owner) {
+      require_auth(owner);
+
+      unclaimed uc(_self, owner.value);
+      check(uc.begin() != uc.end(), "no unclaimed credits found");
+      for (auto it = uc.begin(); it != uc.end();) {
+         if (!it->refund) { // supply was added on arrival
+            add_balance(it->contract, owner, it->balance, owner);
+         } else {
+            action(permission_level{_self, "active"_n}, it->contract, "transfer"_n,
+                   transfer_args{_self, owner, it->balance, "icp netted transfer"}).send();
+         }
+         it = uc.erase(it);
+      }
    }
 
    void token::icpreceive(name contract, name icp_from, name to, asset quantity, string memo, uint8_t refund) {
@@ -75,23 +241,141 @@ namespace icp {
       }
    }
 
+   void token::icprecvnet(name contract, vector<icp_credit> credits, asset total, uint8_t refund) {
+      // NB: this permission should be authorized to icp contract's `eosio.code` permission
+      require_auth2(_self.value, "callback"_n.value);
+
+      check(!credits.empty(), "empty netted credits");
+      int64_t sum = 0;
+      for (const auto& c: credits) {
+         check(c.quantity.symbol == total.symbol, "symbol precision mismatch");
+         check(c.quantity.amount > 0, "must transfer positive quantity");
+         check(c.quantity.amount <= asset::max_amount - sum, "netted credits overflow");
+         sum += c.quantity.amount;
+      }
+      check(sum == total.amount, "netted credits mismatch settlement amount");
+
+      if (!refund) {
+         add_supply(contract, total); // one `stat` update for the whole window
+      }
+      for (const auto& c: credits) {
+         if (!is_account(c.to)) { // NB: one bad receiver must not fail the whole window
+            unclaimed uc(_self, c.to.value);
+            uc.emplace(_self, [&](auto& o) {
+               o.pk = uc.available_primary_key();
+               o.contract = contract;
+               o.balance = c.quantity;
+               o.refund = refund;
+            });
+         } else if (!refund) {
+            require_recipient(c.to);
+            add_balance(contract, c.to, c.quantity, _self);
+         } else {
+            action(permission_level{_self, "active"_n}, contract, "transfer"_n,
+                   transfer_args{_self, c.to, c.quantity, "icp netted transfer"}).send();
+         }
+      }
+   }
+
    void token::icpreceipt(uint64_t seq, uint8_t status, bytes data) {
       // NB: this permission should be authorized to icp contract's `eosio.code` permission
       require_auth2(_self.value, "callback"_n.value);
 
-      locked l(_self, _self.value);
+      auto expired = static_cast<receipt_status>(status) == receipt_status::expired; // icp transfer transaction expired or failed, so release locked asset
+
+      locks l(_self, _self.value);
       auto it = l.find(seq);
       if (it != l.end()) {
-         if (static_cast<receipt_status>(status) == receipt_status::expired) { // icp transfer transaction expired or failed, so release locked asset
-            if (!it->refund) {
-               action(permission_level{_self, "active"_n}, it->contract, "transfer"_n,
-                      transfer_args{_self, it->account, it->balance, "icp release locked asset"}).send();
-            } else {
-               mint(it->contract, it->account, it->balance);
+         settle_locked(seq, it->contract, it->account, it->balance, it->refund, expired);
+         l.erase(it);
+         return;
+      }
+
+      locked legacy(_self, _self.value);
+      auto lit = legacy.find(seq);
+      if (lit != legacy.end()) {
+         settle_locked(seq, lit->contract, lit->account, lit->balance, lit->refund, expired);
+         legacy.erase(lit);
+      }
+   }
+
+   void token::settle_locked(uint64_t seq, name contract, name account, asset balance, bool refund, bool expired) {
+      if (account == _self) { // netting window
+         netted nl(_self, _self.value);
+         const auto& n = nl.get(seq, "no netted credits found");
+         if (expired) {
+            for (const auto& c: n.credits) {
+               release_locked(contract, c.from, c.quantity, refund);
             }
          }
+         nl.erase(n);
+      } else if (expired) {
+         release_locked(contract, account, balance, refund);
+      }
+   }
 
-         l.erase(it);
+   void token::sweeplocked(uint32_t max) {
+      check(max > 0, "max must be positive");
+
+      sweep_locked(max, has_auth(_self));
+   }
+
+   void token::setsweep(uint32_t batch) {
+      require_auth(_self);
+
+      sweep_singleton(_self, _self.value).set(sweep_config{batch}, _self);
+   }
+
+   void token::sweep_locked(uint32_t max, bool release_missing) {
+      icp_packets packets(co().icp, co().icp.value);
+      locks l(_self, _self.value);
+      auto n = now();
+
+      // legacy rows carry no expiration, so take it from their packets
+      // NB: a row without packet can only be released by `release_missing`, so its expiration does not matter
+      locked legacy(_self, _self.value);
+      for (auto it = legacy.begin(); it != legacy.end() && max > 0; --max) {
+         auto p = packets.find(it->seq);
+         l.emplace(_self, [&](auto& o) {
+            o.seq = it->seq;
+            o.contract = it->contract;
+            o.account = it->account;
+            o.balance = it->balance;
+            o.refund = it->refund;
+            o.expiration = p != packets.end() ? p->expiration : n;
+         });
+         it = legacy.erase(it);
+      }
+
+      auto by_expiration = l.get_index<"expiration"_n>();
+      for (auto it = by_expiration.begin(); it != by_expiration.end() && it->expiration <= n && max > 0;) {
+         auto p = packets.find(it->seq);
+         if (p == packets.end() ? !release_missing : static_cast<receipt_status>(p->status) == receipt_status::unknown) {
+            // its receipt may still be relayed, or the packet was cleared without proof of failure,
+            // so look again later rather than let it hold up the locks behind it
+            auto next = it;
+            ++next;
+            by_expiration.modify(it, same_payer, [&](auto& o) {
+               o.expiration = n + sweep_retry_delay;
+            });
+            it = next;
+            continue;
+         }
+
+         // NB: a missing packet proves nothing, e.g., after `closechannel` clearing all packets, so releasing it is the owner's call
+         auto expired = p == packets.end() || static_cast<receipt_status>(p->status) == receipt_status::expired;
+         settle_locked(it->seq, it->contract, it->account, it->balance, it->refund, expired);
+         it = by_expiration.erase(it);
+         --max;
+      }
+   }
+
+   void token::release_locked(name contract, name account, asset quantity, bool refund) {
+      if (!refund) {
+         action(permission_level{_self, "active"_n}, contract, "transfer"_n,
+                transfer_args{_self, account, quantity, "icp release locked asset"}).send();
+      } else {
+         issue(contract, account, quantity); // NB: anyone may sweep, so not `mint`
       }
    }
 
@@ -100,20 +384,22 @@ namespace icp {
 
       check(memo.size() <= 256, "memo has more than 256 bytes");
 
-      burn(contract, from, quantity);
+      burn(contract, from, quantity, !nets(memo)); // netted supply is settled once per window
 
-      icp_transfer(contract, from, icp_to, quantity, std::move(memo), expiration, true); // TODO: original memo?
+      icp_transfer(contract, from, icp_to, quantity, memo, expiration, true); // TODO: original memo?
    }
 
    void token::icptransfer(name contract, name from, name icp_to, asset quantity, string memo, uint32_t expiration) {
       require_auth(from);
 
-      deposits dps(_self, contract.value);
-      auto by_account_asset = dps.get_index<"accountasset"_n>();
-      const auto &dp = by_account_asset.get(account_asset_key(from, quantity), "no deposit object found");
-      check(dp.balance.amount >= quantity.amount, "overdrawn balance");
+      owner_deposits dps(_self, from.value);
+      uint64_t pk;
+      auto dp = find_or_migrate<deposits>(dps, contract, from, quantity.symbol, from, pk);
+      check(dp != dps.end(), "no deposit object found");
+      check(dp->balance.symbol == quantity.symbol, "symbol precision mismatch");
+      check(dp->balance.amount >= quantity.amount, "overdrawn balance");
 
-      if (dp.balance.amount == quantity.amount) {
+      if (dp->balance.amount == quantity.amount) {
          dps.erase(dp);
       } else {
          dps.modify(dp, from, [&](auto &a) {
@@ -121,43 +407,54 @@ namespace icp {
          });
       }
 
-      icp_transfer(contract, from, icp_to, quantity, std::move(memo), expiration, false); // TODO: original memo?
+      icp_transfer(contract, from, icp_to, quantity, memo, expiration, false); // TODO: original memo?
+
+      auto batch = sweep_singleton(_self, _self.value).get_or_default(sweep_config{}).batch;
+      if (batch > 0) { // amortized sweep of stale locked assets
+         sweep_locked(batch, false);
+      }
+   }
+
+   static uint32_t parse_expiration(std::string_view str) {
+      check(!str.empty() && str.size() <= 10, "invalid icp token transfer memo");
+      uint64_t n = 0;
+      for (auto c: str) {
+         check(c >= '0' && c <= '9', "invalid icp token transfer memo");
+         n = n * 10 + (c - '0');
+      }
+      check(n <= std::numeric_limits<uint32_t>::max(), "invalid icp token transfer memo");
+      return static_cast<uint32_t>(n);
    }
 
-   void token::icp_transfer_or_deposit(name contract, name from, name to, asset quantity, string memo) {
+   void token::icp_transfer_or_deposit(name contract, name from, name to, asset quantity, std::string_view memo) {
       // only care about token receiving
-      print("icp_transfer_or_deposit");
       if (to != _self) {
          return;
       }
 
-      if (memo.find("icp ") == 0) { // it is an icp call
-         print("icp");
+      if (memo.substr(0, 4) == "icp ") { // it is an icp call
          auto account_end = memo.find(' ', 4);
-         check(account_end != std::string::npos, "invalid icp token transfer memo");
-         auto n = memo.substr(4, account_end - 4);
-         auto icp_to = eosio::name(n);
-         auto h = memo.substr(account_end + 1);
-         auto icp_expiration = static_cast<uint32_t>(std::stoul(h));
+         check(account_end != std::string_view::npos, "invalid icp token transfer memo");
+         auto icp_to = eosio::name(memo.substr(4, account_end - 4));
+         auto icp_expiration = parse_expiration(memo.substr(account_end + 1));
 
          // TODO: auth `from`
          icp_transfer(contract, from, icp_to, quantity, memo, icp_expiration, false); // TODO: original memo?
 
       } else { // deposit
-         print("deposit");
-         deposits dps(_self, contract.value);
-         auto by_account_asset = dps.get_index<"accountasset"_n>();
-         auto it = by_account_asset.find(account_asset_key(from, quantity));
-         if (it == by_account_asset.end()) {
-            // NB: Must set payer to self, otherwise, "Cannot charge RAM to other accounts during notify".
-            // TODO: charge manually
+         // NB: Must set payer to self, otherwise, "Cannot charge RAM to other accounts during notify".
+         // TODO: charge manually
+         owner_deposits dps(_self, from.value);
+         uint64_t pk;
+         auto it = find_or_migrate<deposits>(dps, contract, from, quantity.symbol, _self, pk);
+         if (it == dps.end()) {
             dps.emplace(_self, [&](auto &a) {
-               a.pk = dps.available_primary_key();
-               a.account = from;
+               a.pk = pk;
+               a.contract = contract;
                a.balance = quantity;
             });
          } else {
-            by_account_asset.modify(it, same_payer, [&](auto &a) {
+            dps.modify(it, same_payer, [&](auto &a) {
                a.balance += quantity;
             });
          }
@@ -167,7 +464,39 @@ namespace icp {
    void token::mint(name contract, name to, asset quantity) {
       require_auth(_self);
 
+      issue(contract, to, quantity);
+   }
+
+   void token::issue(name contract, name to, asset quantity) {
       check(is_account(to), "to account does not exist");
+
+      add_supply(contract, quantity);
+
+      require_recipient(to);
+
+      add_balance(contract, to, quantity, _self); // TODO: self as ram payer?
+   }
+
+   void token::burn(name contract, name from, asset quantity, bool update_supply) {
+      check(is_account(from), "from account does not exist");
+
+      if (update_supply) {
+         sub_supply(contract, quantity);
+      } else {
+         check( quantity.is_valid(), "invalid quantity" );
+         check( quantity.amount > 0, "must burn positive quantity" );
+
+         stats statstable(_self, contract.value);
+         auto& st = statstable.get(quantity.symbol.code().raw(), "token with symbol does not exist, create token before burn");
+         check(quantity.symbol == st.supply.symbol, "symbol precision mismatch");
+      }
+
+      require_recipient(from);
+
+      sub_balance(contract, from, quantity);
+   }
+
+   void token::add_supply(name contract, asset quantity) {
       check(quantity.is_valid(), "invalid quantity");
       check(quantity.amount > 0, "must mint positive quantity");
 
@@ -178,17 +507,12 @@ namespace icp {
       check(quantity.symbol == st.supply.symbol, "symbol precision mismatch");
       check(quantity.amount <= std::numeric_limits<int64_t>::max() - st.supply.amount, "quantity exceeds available supply");
 
-      require_recipient(to);
-
       statstable.modify(st, same_payer, [&](auto &s) {
          s.supply += quantity;
       });
-
-      add_balance(contract, to, quantity, _self); // TODO: self as ram payer?
    }
 
-   void token::burn(name contract, name from, asset quantity) {
-      check(is_account(from), "from account does not exist");
+   void token::sub_supply(name contract, asset quantity) {
       check( quantity.is_valid(), "invalid quantity" );
       check( quantity.amount > 0, "must burn positive quantity" );
 
@@ -199,13 +523,9 @@ namespace icp {
       check(quantity.symbol == st.supply.symbol, "symbol precision mismatch");
       check(quantity.amount <= st.supply.amount, "quantity exceeds available supply");
 
-      require_recipient(from);
-
       statstable.modify(st, same_payer, [&](auto &s) {
          s.supply -= quantity;
       });
-
-      sub_balance(contract, from, quantity);
    }
 
 }
@@ -219,7 +539,7 @@ extern "C" {
       }
       if (code == self || action == "onerror"_n.value) {
          switch (action) {
-            EOSIO_DISPATCH_HELPER(icp::token, (setcontracts)(create)(transfer)(icpreceive)(icpreceipt)(icptransfer)(icprefund))
+            EOSIO_DISPATCH_HELPER(icp::token, (setcontracts)(create)(transfer)(icpreceive)(icprecvnet)(icpreceipt)(icptransfer)(icprefund)(setnetting)(flushnet)(claimnet)(migrate)(sweeplocked)(setsweep))
          }
       }
       if (code != self && action == "transfer"_n.value) {
@@ -227,12 +547,20 @@ extern "C" {
          size_t size = action_data_size();
          void* buffer = max_stack_buffer_size < size ? malloc(size) : alloca(size);
          read_action_data( buffer, size );
-         icp::transfer_args args;
+
+         // NB: `transfer_args` is unpacked by hand, so that the memo is viewed in place rather than copied
+         eosio::name from, to;
+         eosio::asset quantity;
+         eosio::unsigned_int memo_size;
          eosio::datastream<const char*> ds((char*)buffer, size);
-         ds >> args;
+         ds >> from >> to >> quantity >> memo_size;
+         eosio::check(memo_size.value <= ds.remaining(), "invalid transfer memo");
+         std::string_view memo(ds.pos(), memo_size.value);
 
-         icp::token thiscontract(eosio::name(self), eosio::name(code), ds); // TODO: `code` and `ds` are useless
-         thiscontract.icp_transfer_or_deposit(eosio::name(code), args.from, args.to, args.quantity, args.memo);
+         if (to.value == self) { // only care about token receiving
+            icp::token thiscontract(eosio::name(self), eosio::name(code), ds); // TODO: `code` and `ds` are useless
+            thiscontract.icp_transfer_or_deposit(eosio::name(code), from, to, quantity, memo);
+         }
 
          if ( max_stack_buffer_size < size ) {
             free(buffer);
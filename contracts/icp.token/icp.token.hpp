@@ -1,5 +1,8 @@
 #pragma once
 
+#include <optional>
+#include <string_view>
+
 #include <eosiolib/asset.hpp>
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/singleton.hpp>
@@ -10,6 +13,17 @@ namespace icp {
    using namespace std;
    using namespace eosio;
 
+   /** Per-user credit carried by a netted icp packet.
+    * @param from - the sender on this chain
+    * @param to - the receiver on the peer chain
+    * @param quantity - the transferred asset
+    */
+   struct icp_credit {
+      name from;
+      name to;
+      asset quantity;
+   };
+
    class [[eosio::contract("icp.token")]] token : public contract {
    public:
       token(name s, name code, datastream<const char*> ds);
@@ -33,6 +47,17 @@ namespace icp {
       [[eosio::action]]
       void icpreceive(name contract, name icp_from, name to, asset quantity, string memo, uint8_t refund);
 
+      /** Receive netted asset transfers from peer contract.
+       * Credits to accounts that do not exist are kept as `unclaimed_credit` instead of failing the window.
+       *
+       * @param contract - the token contract
+       * @param credits - the per-user credits of the netting window
+       * @param total - the net settlement amount, i.e., the sum of all credits
+       * @param refund
+       */
+      [[eosio::action]]
+      void icprecvnet(name contract, vector<icp_credit> credits, asset total, uint8_t refund);
+
       /**
        *
        * @param seq
@@ -50,7 +75,7 @@ namespace icp {
        * @param quantity
        * @param memo
        */
-      void icp_transfer_or_deposit(name contract, name from, name to, asset quantity, string memo);
+      void icp_transfer_or_deposit(name contract, name from, name to, asset quantity, std::string_view memo);
 
       /** Transfer asset with icp.
        * The asset must have been deposited by `icp_transfer_or_deposit`.
@@ -66,19 +91,102 @@ namespace icp {
       [[eosio::action]]
       void icprefund(name contract, name from, name icp_to, asset quantity, string memo, uint32_t expiration);
 
+      /** Set the netting window for outgoing icp transfers.
+       * Transfers of the same (contract, symbol) are queued and flushed as one packet,
+       * once the window is older than `window` seconds or holds `max_entries` transfers.
+       * Windows are only checked when a transfer is queued, so a due window is sent by the next
+       * transfer of its token or by `flushnet`, never by time alone.
+       * Only transfers in the same direction are netted, i.e., transfers and refunds of a token keep
+       * separate windows and are not offset against each other.
+       * Transfers with a memo are never netted, since a netted packet does not carry memos.
+       * @param window - the maximum seconds a transfer waits, 0 disables netting
+       * @param max_entries - the maximum number of transfers per window
+       */
+      [[eosio::action]]
+      void setnetting(uint32_t window, uint32_t max_entries);
+
+      /** Flush the netting window of the specified token.
+       * Anyone can flush a due window, while this contract can flush any window.
+       * A window that expired before being sent is cancelled, i.e., its credits are given back.
+       * @param contract - the token contract
+       * @param sym - the token symbol
+       * @param refund - whether the window is flowing back to the original chain
+       */
+      [[eosio::action]]
+      void flushnet(name contract, symbol sym, uint8_t refund);
+
+      /** Claim the netted credits received before the owner account existed.
+       * @param owner - the receiver on this chain
+       */
+      [[eosio::action]]
+      void claimnet(name owner);
+
+      /** Move legacy `accounts` and `deposit` rows of the specified token contract to owner-scoped tables.
+       * Rows are also migrated once touched, so this only needs to drain the idle ones.
+       * @param contract - the token contract, i.e., the scope of legacy tables
+       * @param max - the maximum number of rows to move
+       */
+      [[eosio::action]]
+      void migrate(name contract, uint32_t max);
+
+      /** Settle locked assets whose packets are past expiration.
+       * Each lock is cross-checked with the icp contract's packet: it is released or minted back
+       * once the packet is proven expired, and kept while its receipt may still be relayed.
+       * Locks whose packets no longer exist, e.g., after a channel reset, are only released
+       * with this contract's authority.
+       * Locks that cannot be settled yet are put off by `sweep_retry_delay` and do not count against `max`.
+       * @param max - the maximum number of locks to settle
+       */
+      [[eosio::action]]
+      void sweeplocked(uint32_t max);
+
+      /** Set the amortized sweep of locked assets run by `icptransfer`.
+       * @param batch - the maximum number of locks settled per transfer, 0 disables it
+       */
+      [[eosio::action]]
+      void setsweep(uint32_t batch);
+
    private:
       void sub_balance(name contract, name owner, asset value);
       void add_balance(name contract, name owner, asset value, name ram_payer);
 
-      void icp_transfer(name contract, name from, name icp_to, asset quantity, string memo, uint32_t expiration, bool refund);
+      struct collaborative_contract;
+      const collaborative_contract& co();
+      void icp_transfer(name contract, name from, name icp_to, asset quantity, std::string_view memo, uint32_t expiration, bool refund);
+      void send_packet(uint64_t seq, const action& icp_send, uint32_t expiration);
+      void release_locked(name contract, name account, asset quantity, bool refund);
+      void settle_locked(uint64_t seq, name contract, name account, asset balance, bool refund, bool expired);
+      void sweep_locked(uint32_t max, bool release_missing);
+      static constexpr uint32_t sweep_retry_delay = 60 * 60; // seconds before an unsettled lock is looked at again
+
+      struct netting_config;
+      struct netting_window;
+      const netting_config& netting();
+      bool nets(std::string_view memo);
+      bool netting_due(const netting_window& w);
+      void queue_netting(name contract, name from, name icp_to, asset quantity, uint32_t expiration, bool refund);
+      void flush_netting(const netting_window& w);
+      void cancel_netting(const netting_window& w);
 
       void mint(name contract, name to, asset quantity);
-      void burn(name contract, name from, asset quantity);
+      void issue(name contract, name to, asset quantity);
+      void burn(name contract, name from, asset quantity, bool update_supply = true);
+      void add_supply(name contract, asset quantity);
+      void sub_supply(name contract, asset quantity);
 
       static uint128_t account_asset_key(const name& account, const asset& balance) {
             return (uint128_t(account.value) << 64) + balance.symbol.code().raw();
       }
 
+      static uint128_t contract_asset_key(const name& contract, const symbol& sym) {
+            return (uint128_t(contract.value) << 64) + sym.code().raw();
+      }
+
+      // a symbol code takes at most 56 bits, which leaves the lowest bit for the direction
+      static uint128_t netting_key(const name& contract, const asset& quantity, uint8_t refund) {
+            return (uint128_t(contract.value) << 64) | (quantity.symbol.code().raw() << 1) | (refund ? 1 : 0);
+      }
+
       /** Collaborative contracts.
        * @param icp - the base icp contract on local chain
        * @param peer - the icp.token contract on peer chain
@@ -88,7 +196,21 @@ namespace icp {
          name peer = name();
       };
 
-      /** Asset account for transferred from peer chain.
+      /** Asset balance or deposit of one owner.
+       * @param scope - the owner
+       * @param contract - the token contract
+       * @param balance - the asset balance
+       */
+      struct [[eosio::table, eosio::contract("icp.token")]] owner_balance {
+         uint64_t pk;
+         name contract;
+         asset balance;
+
+         auto primary_key()const { return pk; }
+         uint128_t by_contract_asset() const { return contract_asset_key(contract, balance.symbol); }
+      };
+
+      /** Legacy asset account for transferred from peer chain, superseded by `balances`.
        * @param scope - the token contract from peer chain
        * @param account - the owner
        * @param balance - the asset balance
@@ -112,7 +234,7 @@ namespace icp {
          uint64_t primary_key()const { return supply.symbol.code().raw(); }
       };
 
-      /** Pre-deposit asset for future icp transfer.
+      /** Legacy pre-deposit asset for future icp transfer, superseded by `deposits`.
        * @param scope - the token contract
        * @param account - the owner
        * @param balance - the transferred asset
@@ -126,7 +248,7 @@ namespace icp {
          uint128_t by_account_asset() const { return account_asset_key(account, balance); }
       };
 
-      /** Temporary locked asset for icp transfer.
+      /** Legacy temporary locked asset for icp transfer, superseded by `locks`.
        * If icp transfer failed (eg. expired), it will be released to the original sender.
        * Otherwise (eg. succeeded), it will just be erased, i.e., the asset will be kept by this contract.
        * @param scope - this contract
@@ -145,6 +267,108 @@ namespace icp {
          uint64_t primary_key()const { return seq; }
       };
 
+      /** Temporary locked asset for icp transfer.
+       * If icp transfer failed (eg. expired), it will be released to the original sender.
+       * Otherwise (eg. succeeded), it will just be erased, i.e., the asset will be kept by this contract.
+       * Locks whose receipts never arrive are settled by `sweeplocked`.
+       * @param scope - this contract
+       * @param seq - the icp packet sequence
+       * @param contract - the token contract
+       * @param account - the sender
+       * @param balance - the transferred asset
+       * @param expiration - the icp packet expiration
+       */
+      struct [[eosio::table, eosio::contract("icp.token")]] expiring_lock {
+         uint64_t seq;
+         name contract;
+         name account;
+         asset balance;
+         uint8_t refund;
+         uint32_t expiration;
+
+         uint64_t primary_key()const { return seq; }
+         uint64_t by_expiration()const { return expiration; }
+      };
+
+      /** Sweep config.
+       * @param batch - the maximum number of locks settled per `icptransfer`, 0 disables it
+       */
+      struct [[eosio::table("sweep"), eosio::contract("icp.token")]] sweep_config {
+         uint32_t batch = 0;
+      };
+
+      /** Mirror of the icp contract's `packets` row, only read for the packet status.
+       */
+      struct icp_packet_row {
+         uint64_t seq;
+         uint32_t expiration;
+         bytes send_action;
+         bytes receipt_action;
+         uint8_t status;
+         uint8_t shadow;
+
+         uint64_t primary_key()const { return seq; }
+      };
+
+      /** Netting window config.
+       * @param window - the maximum seconds a transfer waits in a window, 0 disables netting
+       * @param max_entries - the maximum number of transfers in a window
+       */
+      struct [[eosio::table("netting"), eosio::contract("icp.token")]] netting_config {
+         uint32_t window = 0;
+         uint32_t max_entries = 0;
+      };
+
+      /** Pending outgoing icp transfers of one (contract, symbol), flushed as one packet.
+       * @param scope - this contract
+       * @param contract - the token contract
+       * @param total - the net settlement amount
+       * @param refund - whether the window is flowing back to the original chain
+       * @param opened - the time when the first transfer was queued
+       * @param expiration - the earliest expiration of the queued transfers
+       * @param credits - the queued transfers
+       */
+      struct [[eosio::table, eosio::contract("icp.token")]] netting_window {
+         uint64_t pk;
+         name contract;
+         asset total;
+         uint8_t refund;
+         uint32_t opened;
+         uint32_t expiration;
+         vector<icp_credit> credits;
+
+         auto primary_key()const { return pk; }
+         uint128_t by_contract_asset() const { return netting_key(contract, total, refund); }
+      };
+
+      /** Credits of a flushed netting window, released one by one if the packet fails.
+       * The corresponding `expiring_lock` row has this contract as the account.
+       * @param scope - this contract
+       * @param seq - the icp packet sequence
+       * @param credits - the netted transfers
+       */
+      struct [[eosio::table, eosio::contract("icp.token")]] netted_credits {
+         uint64_t seq;
+         vector<icp_credit> credits;
+
+         uint64_t primary_key()const { return seq; }
+      };
+
+      /** Netted credit whose receiver did not exist when the window arrived.
+       * @param scope - the receiver
+       * @param contract - the token contract
+       * @param balance - the credited asset
+       * @param refund - whether it is held by this contract on the original chain
+       */
+      struct [[eosio::table, eosio::contract("icp.token")]] unclaimed_credit {
+         uint64_t pk;
+         name contract;
+         asset balance;
+         uint8_t refund;
+
+         auto primary_key()const { return pk; }
+      };
+
       typedef eosio::singleton<"co"_n, collaborative_contract> co_singleton;
       typedef eosio::multi_index<"accounts"_n, account,
          indexed_by<"accountasset"_n, const_mem_fun<account, uint128_t, &account::by_account_asset>>
@@ -153,9 +377,88 @@ namespace icp {
       typedef eosio::multi_index<"deposit"_n, account_deposit,
          indexed_by<"accountasset"_n, const_mem_fun<account_deposit, uint128_t, &account_deposit::by_account_asset>>
       > deposits;
+      typedef eosio::multi_index<"balances"_n, owner_balance,
+         indexed_by<"contractasset"_n, const_mem_fun<owner_balance, uint128_t, &owner_balance::by_contract_asset>>
+      > owner_balances;
+      typedef eosio::multi_index<"deposits"_n, owner_balance,
+         indexed_by<"contractasset"_n, const_mem_fun<owner_balance, uint128_t, &owner_balance::by_contract_asset>>
+      > owner_deposits;
       typedef eosio::multi_index<"locked"_n, account_locked> locked;
+      typedef eosio::multi_index<"locks"_n, expiring_lock,
+         indexed_by<"expiration"_n, const_mem_fun<expiring_lock, uint64_t, &expiring_lock::by_expiration>>
+      > locks;
+      typedef eosio::singleton<"sweep"_n, sweep_config> sweep_singleton;
+      typedef eosio::multi_index<"packets"_n, icp_packet_row> icp_packets;
+      typedef eosio::singleton<"netting"_n, netting_config> netting_singleton;
+      typedef eosio::multi_index<"netwindow"_n, netting_window,
+         indexed_by<"contractasset"_n, const_mem_fun<netting_window, uint128_t, &netting_window::by_contract_asset>>
+      > netting_windows;
+      typedef eosio::multi_index<"netlocked"_n, netted_credits> netted;
+      typedef eosio::multi_index<"unclaimed"_n, unclaimed_credit> unclaimed;
+
+      /** Find the row of (contract, symbol) in an owner-scoped table.
+       * @param pk - set to the primary key of the row, or to a free one if not found
+       */
+      template<typename Table>
+      static typename Table::const_iterator find_contract_asset(const Table& table, name contract, const symbol& sym, uint64_t& pk) {
+         auto by_contract_asset = table.template get_index<"contractasset"_n>();
+         auto it = by_contract_asset.find(contract_asset_key(contract, sym));
+         if (it == by_contract_asset.end()) {
+            pk = table.available_primary_key();
+            return table.end();
+         }
+         pk = it->pk;
+         return table.iterator_to(*it);
+      }
+
+      /** Find the owner-scoped row of (contract, symbol), moving the legacy row over if there is one.
+       * @param pk - set to the primary key of the row, or to a free one if not found
+       */
+      template<typename Legacy, typename Table>
+      typename Table::const_iterator find_or_migrate(Table& table, name contract, name owner, const symbol& sym, name ram_payer, uint64_t& pk) {
+         auto it = find_contract_asset(table, contract, sym, pk);
+         if (it != table.end()) {
+            return it;
+         }
+
+         Legacy legacy(_self, contract.value);
+         if (legacy.begin() == legacy.end()) { // fully migrated
+            return it;
+         }
+         auto by_account_asset = legacy.template get_index<"accountasset"_n>();
+         auto lit = by_account_asset.find(account_asset_key(owner, asset(0, sym)));
+         if (lit == by_account_asset.end()) {
+            return it;
+         }
+
+         auto balance = lit->balance;
+         by_account_asset.erase(lit);
+         return table.emplace(ram_payer, [&](auto &a) {
+            a.pk = pk;
+            a.contract = contract;
+            a.balance = balance;
+         });
+      }
+
+      template<typename Table>
+      void credit_balance(Table& table, name contract, const asset& value, name ram_payer) {
+         uint64_t pk;
+         auto it = find_contract_asset(table, contract, value.symbol, pk);
+         if (it == table.end()) {
+            table.emplace(ram_payer, [&](auto &a) {
+               a.pk = pk;
+               a.contract = contract;
+               a.balance = value;
+            });
+         } else {
+            table.modify(it, same_payer, [&](auto &a) {
+               a.balance += value;
+            });
+         }
+      }
 
-      collaborative_contract _co;
+      std::optional<collaborative_contract> _co;
+      std::optional<netting_config> _netting;
    };
 
 }
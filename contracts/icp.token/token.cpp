@@ -62,13 +62,15 @@ namespace icp {
    }
 
    void token::sub_balance(name contract, name owner, asset value) {
-      accounts from_acnts(_self, contract.value);
+      owner_balances from_acnts(_self, owner.value);
 
-      auto by_account_asset = from_acnts.get_index<"accountasset"_n>();
-      const auto& from = by_account_asset.get(account_asset_key(owner, value), "no balance object found");
-      check(from.balance.amount >= value.amount, "overdrawn balance");
+      uint64_t pk;
+      auto from = find_or_migrate<accounts>(from_acnts, contract, owner, value.symbol, owner, pk);
+      check(from != from_acnts.end(), "no balance object found");
+      check(from->balance.symbol == value.symbol, "symbol precision mismatch");
+      check(from->balance.amount >= value.amount, "overdrawn balance");
 
-      if (from.balance.amount == value.amount) {
+      if (from->balance.amount == value.amount) {
          from_acnts.erase(from);
       } else {
          from_acnts.modify(from, owner, [&](auto &a) {
@@ -78,20 +80,41 @@ namespace icp {
    }
 
    void token::add_balance(name contract, name owner, asset value, name ram_payer) {
-      accounts to_acnts(_self, contract.value);
-      auto by_account_asset = to_acnts.get_index<"accountasset"_n>();
-      auto to = by_account_asset.find(account_asset_key(owner, value));
-      if (to == by_account_asset.end()) {
+      owner_balances to_acnts(_self, owner.value);
+
+      uint64_t pk;
+      auto to = find_or_migrate<accounts>(to_acnts, contract, owner, value.symbol, ram_payer, pk);
+      if (to == to_acnts.end()) {
          to_acnts.emplace(ram_payer, [&](auto &a) {
-            a.pk = to_acnts.available_primary_key();
-            a.account = owner;
+            a.pk = pk;
+            a.contract = contract;
             a.balance = value;
          });
       } else {
-         to_acnts.modify(*to, same_payer, [&](auto &a) {
+         to_acnts.modify(to, same_payer, [&](auto &a) {
             a.balance += value;
          });
       }
    }
 
+   void token::migrate(name contract, uint32_t max) {
+      require_auth(_self);
+
+      check(max > 0, "max must be positive");
+
+      accounts acnts(_self, contract.value);
+      for (auto it = acnts.begin(); it != acnts.end() && max > 0; --max) {
+         owner_balances to_acnts(_self, it->account.value);
+         credit_balance(to_acnts, contract, it->balance, _self);
+         it = acnts.erase(it);
+      }
+
+      deposits dps(_self, contract.value);
+      for (auto it = dps.begin(); it != dps.end() && max > 0; --max) {
+         owner_deposits to_dps(_self, it->account.value);
+         credit_balance(to_dps, contract, it->balance, _self);
+         it = dps.erase(it);
+      }
+   }
+
 }
@@ -110,6 +110,7 @@ void fork_store::add_block_header_with_merkle_path(const block_header_state& h,
             add_block_id(by_blockid, *it, *pit);
         }
         meter_add_blocks(merkle_path.size() - 1);
+        _stats.ids_linked += merkle_path.size() - 1;
     }
     // mroot.append(h.id); // last
     check(h.blockroot_merkle.get_root() == mroot.get_root(), "unlinkable block");
@@ -122,6 +123,7 @@ void fork_store::add_block_state(const block_header_state& block_state) {
     check(by_blockid.find(to_key256(block_state.id)) == by_blockid.end(), "already existing block");
 
     meter_add_blocks(1);
+    ++_stats.headers_added;
 
     _block_states.emplace(_code, [&](auto& b) {
        b.pk = _block_states.available_primary_key();
@@ -191,6 +193,7 @@ void fork_store::cutdown(uint32_t block_num, uint32_t& max_num) {
             if (max_num <= 0) break; --max_num;
             by_blocknum.erase(it);
             it = by_blocknum.begin();
+            ++_stats.blocks_reclaimed;
         }
     }
     {
@@ -203,6 +206,7 @@ void fork_store::cutdown(uint32_t block_num, uint32_t& max_num) {
             ++num;
         }
         meter_remove_blocks(num);
+        _stats.blocks_reclaimed += num;
     }
 }
 
@@ -255,6 +259,7 @@ void fork_store::add_block_header(const block_header& h) {
     by_blockid.modify(b, same_payer, [&](auto& o) {
         o.action_mroot = h.action_mroot; // TODO: assignment
     });
+    ++_stats.headers_added;
 }
 
 /* void fork_store::add_block_id(const capi_checksum256& block_id, const capi_checksum256& previous) {
@@ -324,6 +329,7 @@ void fork_store::meter_add_blocks(uint32_t num) {
     meter.current_blocks += num;
     check(meter.current_blocks <= meter.max_blocks, "exceed max blocks");
     _store_meter.set(meter, _code);
+    _stats.peak_blocks = std::max(_stats.peak_blocks, meter.current_blocks);
 }
 
 void fork_store::meter_remove_blocks(uint32_t num) {
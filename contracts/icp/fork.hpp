@@ -103,6 +103,14 @@ struct [[eosio::table("storemeter"), eosio::contract("icp")]] store_meter {
 };
 typedef singleton<"storemeter"_n, store_meter> store_meter_singleton;
 
+/* Counters collected by a fork store during one action, see `icp_metrics` */
+struct fork_store_stats {
+    uint32_t headers_added = 0;
+    uint32_t ids_linked = 0;
+    uint32_t blocks_reclaimed = 0;
+    uint32_t peak_blocks = 0;
+};
+
 using fork_store_ptr = std::shared_ptr<class fork_store>;
 
 class fork_store {
@@ -116,6 +124,7 @@ public:
     void add_block_header(const block_header& h);
     void cutdown(uint32_t block_num, uint32_t& max_num);
     capi_checksum256 get_action_mroot(const capi_checksum256& block_id);
+    const fork_store_stats& stats() const { return _stats; }
 
 private:
     bool is_producer(name name, const eosio::public_key& key);
@@ -149,6 +158,7 @@ private:
     producer_schedule_singleton _active_schedule;
     pending_schedule_singleton _pending_schedule;
     store_meter_singleton _store_meter;
+    fork_store_stats _stats;
 };
 
 }
@@ -24,6 +24,21 @@ icp::icp(name s, name code, datastream<const char*> ds)
    }
 }
 
+icp::~icp() {
+   const auto& st = _store->stats();
+   if (st.headers_added || st.ids_linked || st.blocks_reclaimed || st.peak_blocks) {
+      auto& m = metrics();
+      m.headers_added += st.headers_added;
+      m.ids_linked += st.ids_linked;
+      m.rows_reclaimed += st.blocks_reclaimed;
+      m.peak_blocks = std::max(m.peak_blocks, st.peak_blocks);
+   }
+
+   if (_metrics) {
+      metrics_singleton(_self, _self.value).set(*_metrics, _self);
+   }
+}
+
 void icp::setpeer(name peer) {
    require_auth(_self);
 
@@ -104,6 +119,7 @@ void icp::sendaction(uint64_t seq, const bytes& send_action, uint32_t expiration
    packets.emplace(_self, [&](auto& p) {
       p = packet;
    });
+   ++metrics().packets_sent;
 
    // action `ispacket` does not exist, so nothing will happen locally
    action(vector<permission_level>{}, _self, "ispacket"_n, packet).send();
@@ -159,11 +175,13 @@ void icp::onpacket(const icpaction& ia) {
    ++_peer.last_incoming_packet_seq;
    ++_peer.last_outgoing_receipt_seq;
    update_peer(); // update `last_outgoing_receipt_seq`
+   ++metrics().packets_received;
 
    receipt_table receipts(_self, _self.value);
 
    if (packet.expiration <= now()) {
       print_f("icp action has expired: % <= now %", uint64_t(packet.expiration), uint64_t(now()));
+      ++metrics().packets_expired;
 
       icp_receipt receipt{_peer.last_outgoing_receipt_seq, packet.seq, static_cast<uint8_t>(receipt_status::expired), {}};
       receipts.emplace(_self, [&](auto& r) {
@@ -211,6 +229,8 @@ void icp::onreceipt(const icpaction& ia) {
    packets.modify(packet, same_payer, [&](auto& p) {
       p.status = receipt.status;
    });
+   ++metrics().receipts_received;
+   if (status == receipt_status::expired) ++metrics().receipts_expired;
 
    if (not packet.receipt_action.empty()) {
       // this action call **cannot** fail, otherwise the icp will not proceed any more
@@ -275,8 +295,11 @@ void icp::cleanup(uint32_t max_num) {
    for (auto it = receipts.begin(); it != receipts.end() and it->seq <= _peer.last_finalised_outgoing_receipt_seq;) {
       if (max_num <= 0) break; --max_num;
       it = receipts.erase(it);
+      ++num;
    }
 
+   if (num > 0) metrics().rows_reclaimed += num;
+
    auto block_num = _peer.max_finished_block_num();
    print("cutdown to block: ", block_num);
    _store->cutdown(block_num, max_num);
@@ -295,6 +318,13 @@ void icp::dummy(name from) {
    INLINE_ACTION_SENDER(eosio::icp, sendaction)(_self, {_self, "sendaction"_n}, {seq, send_action, 0, receive_action});
 }
 
+icp::icp_metrics& icp::metrics() {
+   if (!_metrics) {
+      _metrics = metrics_singleton(_self, _self.value).get_or_default(icp_metrics{});
+   }
+   return *_metrics;
+}
+
 uint64_t icp::next_packet_seq() const {
    return eosio::next_packet_seq(_self);
 }
@@ -311,6 +341,9 @@ void icp::meter_add_packets(uint32_t num) {
    meter.current_packets += num;
    check(meter.current_packets <= meter.max_packets, "exceed max packets");
    icp_meter.set(meter, _self);
+
+   auto& m = metrics();
+   m.peak_packets = std::max(m.peak_packets, meter.current_packets);
 }
 
 void icp::meter_remove_packets(uint32_t num) {
@@ -14,6 +14,7 @@ namespace eosio {
 
 struct [[eosio::contract("icp")]] icp : public contract {
    explicit icp(name s, name code, datastream<const char*> ds);
+   ~icp();
 
    [[eosio::action]]
    void setpeer(name peer);
@@ -68,8 +69,27 @@ private:
 
    typedef eosio::singleton<"icpmeter"_n, icp_meter> meter_singleton;
 
+   /* Cumulative counters, for observing icp health */
+   struct [[eosio::table("icpmetrics"), eosio::contract("icp")]] icp_metrics {
+       uint64_t headers_added = 0; // block headers added by `addblocks` or completed by `addblock`
+       uint64_t ids_linked = 0; // skipped block ids linked by merkle path
+       uint64_t packets_sent = 0;
+       uint64_t packets_received = 0;
+       uint64_t packets_expired = 0; // incoming packets already expired when received
+       uint64_t receipts_received = 0;
+       uint64_t receipts_expired = 0; // outgoing packets reported expired by the peer
+       uint64_t rows_reclaimed = 0; // packets, receipts and blocks erased by `cleanup`
+       uint32_t peak_packets = 0;
+       uint32_t peak_blocks = 0;
+   };
+
+   typedef eosio::singleton<"icpmetrics"_n, icp_metrics> metrics_singleton;
+
+   icp_metrics& metrics(); // loaded on first use, and written back on destruction
+
    peer_contract _peer;
    std::unique_ptr<fork_store> _store;
+   std::optional<icp_metrics> _metrics;
 };
 
 }
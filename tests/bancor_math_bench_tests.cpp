@@ -0,0 +1,209 @@
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "../contracts/eosio.system/include/eosio.system/bancor_math.hpp"
+
+namespace bancor = eosiosystem::bancor;
+
+namespace {
+
+uint64_t env_or( const char* name, uint64_t def ) {
+   const char* v = std::getenv( name );
+   return v ? std::strtoull( v, nullptr, 10 ) : def;
+}
+
+// the floating point formulas of exchange_state::convert_to_exchange, convert_from_exchange
+// and get_bancor_output, for a connector weight of 0.5
+
+int64_t double_issue( int64_t supply, int64_t balance, int64_t in ) {
+   double R(supply), C(balance), F(.5), T(in), ONE(1.0);
+   double E = -R * (ONE - std::pow( ONE + T / C, F) );
+   return int64_t(E);
+}
+
+int64_t double_redeem( int64_t supply, int64_t balance, int64_t in ) {
+   double R(supply - in), C(balance), F(1.0/.5), E(in), ONE(1.0);
+   double T = C * (std::pow( ONE + E/R, F) - ONE);
+   return int64_t(T);
+}
+
+int64_t double_output( int64_t conin, int64_t conout, int64_t in ) {
+   const double F0 = double(conin);
+   const double T0 = double(conout);
+   const double I  = double(in);
+   auto out = int64_t((I*T0) / (I+F0));
+   if ( out < 0 ) out = 0;
+   return out;
+}
+
+// the fixed-point functions, returning -1 where the contract would fall back to floating point
+
+int64_t fixed_issue( int64_t supply, int64_t balance, int64_t in ) {
+   int64_t out = 0;
+   return bancor::half_weight_issue( supply, balance, in, out ) ? out : -1;
+}
+
+int64_t fixed_redeem( int64_t supply, int64_t balance, int64_t in ) {
+   int64_t out = 0;
+   return bancor::half_weight_redeem( supply, balance, in, out ) ? out : -1;
+}
+
+int64_t fixed_output( int64_t conin, int64_t conout, int64_t in ) {
+   int64_t out = 0;
+   return bancor::output( conin, conout, in, out ) ? out : -1;
+}
+
+/**
+ * Samples the realistic parameter space of the RAM market and REX: supplies and connector
+ * balances log-uniformly over several orders of magnitude around the values of a live chain,
+ * and trade sizes from one unit up to a tenth of the connector.
+ */
+struct bancor_sampler {
+   std::mt19937_64 rng;
+
+   explicit bancor_sampler( uint64_t seed ) : rng( seed ) {}
+
+   int64_t log_uniform( double lo, double hi ) {
+      std::uniform_real_distribution<double> d( std::log( lo ), std::log( hi ) );
+      return std::max<int64_t>( 1, int64_t( std::exp( d( rng ) ) ) );
+   }
+
+   struct sample { int64_t supply, balance, in; };
+
+   // RAMCORE supply, connector balance (RAM bytes or core token units) and deposit
+   sample issue() {
+      sample s;
+      s.supply  = log_uniform( 1e12, 1e15 );
+      s.balance = log_uniform( 1e8, 1e14 );
+      s.in      = log_uniform( 1, double(s.balance) / 10 );
+      s.balance += s.in;
+      return s;
+   }
+
+   // RAMCORE supply, connector balance and RAMCORE redeemed
+   sample redeem() {
+      sample s;
+      s.supply  = log_uniform( 1e12, 1e15 );
+      s.balance = log_uniform( 1e8, 1e14 );
+      s.in      = log_uniform( 1, double(s.supply) / 1000 );
+      return s;
+   }
+
+   // REX total_rent / total_unlent connectors and the rented or returned amount
+   sample output() {
+      sample s;
+      s.supply  = log_uniform( 1e4, 1e15 );
+      s.balance = log_uniform( 1e4, 1e15 );
+      s.in      = log_uniform( 1, 1e13 );
+      return s;
+   }
+};
+
+struct comparison {
+   uint64_t samples = 0;
+   uint64_t exact   = 0;
+   int64_t  max_abs = 0;
+
+   void record( int64_t fixed, int64_t floating ) {
+      BOOST_REQUIRE_GE( fixed, 0 );
+      const int64_t diff = std::abs( fixed - floating );
+      ++samples;
+      if( diff == 0 ) ++exact;
+      max_abs = std::max( max_abs, diff );
+   }
+
+   void report( const std::string& name ) const {
+      BOOST_TEST_MESSAGE( name << ": " << samples << " samples, " << exact << " identical, max difference "
+                          << max_abs << " units" );
+   }
+};
+
+typedef std::function<int64_t(int64_t, int64_t, int64_t)> bancor_fn;
+
+double time_per_call_ns( const bancor_fn& f, const std::vector<bancor_sampler::sample>& samples ) {
+   volatile int64_t sink = 0;
+   auto start = std::chrono::steady_clock::now();
+   for( const auto& s : samples ) {
+      sink = sink + f( s.supply, s.balance, s.in );
+   }
+   auto elapsed = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+   return elapsed / samples.size();
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(bancor_math_bench_tests)
+
+BOOST_AUTO_TEST_CASE( isqrt_exact ) {
+   bancor_sampler sampler( env_or( "EOSIO_BENCH_SEED", 1 ) );
+   BOOST_REQUIRE_EQUAL( 0u, bancor::isqrt( 0 ) );
+   BOOST_REQUIRE_EQUAL( 1u, bancor::isqrt( 3 ) );
+   BOOST_REQUIRE_EQUAL( 2u, bancor::isqrt( 4 ) );
+   BOOST_REQUIRE_EQUAL( UINT64_MAX, bancor::isqrt( ~bancor::uint128_t(0) ) );
+   for( int i = 0; i < 100000; ++i ) {
+      const bancor::uint128_t x = (bancor::uint128_t( sampler.rng() ) << (sampler.rng() % 64)) ^ sampler.rng();
+      const bancor::uint128_t s = bancor::isqrt( x );
+      BOOST_REQUIRE( s * s <= x );
+      BOOST_REQUIRE( (s + 1) * (s + 1) > x );
+   }
+}
+
+BOOST_AUTO_TEST_CASE( fixed_point_matches_double ) {
+   const uint64_t n = env_or( "EOSIO_BENCH_BANCOR_SAMPLES", 200000 );
+   bancor_sampler sampler( env_or( "EOSIO_BENCH_SEED", 1 ) );
+
+   comparison issue, redeem, output;
+   for( uint64_t i = 0; i < n; ++i ) {
+      auto a = sampler.issue();
+      issue.record( fixed_issue( a.supply, a.balance, a.in ), double_issue( a.supply, a.balance, a.in ) );
+      auto b = sampler.redeem();
+      redeem.record( fixed_redeem( b.supply, b.balance, b.in ), double_redeem( b.supply, b.balance, b.in ) );
+      auto c = sampler.output();
+      output.record( fixed_output( c.supply, c.balance, c.in ), double_output( c.supply, c.balance, c.in ) );
+   }
+
+   issue.report( "convert_to_exchange" );
+   redeem.report( "convert_from_exchange" );
+   output.report( "get_bancor_output" );
+
+   // the documented bound: both truncate the same expression and the floating point error
+   // stays well below one unit over this parameter space
+   BOOST_REQUIRE_LE( issue.max_abs, 1 );
+   BOOST_REQUIRE_LE( redeem.max_abs, 1 );
+   BOOST_REQUIRE_LE( output.max_abs, 1 );
+}
+
+BOOST_AUTO_TEST_CASE( fixed_point_bancor_bench ) {
+   const uint64_t n = env_or( "EOSIO_BENCH_BANCOR_SAMPLES", 200000 );
+   bancor_sampler sampler( env_or( "EOSIO_BENCH_SEED", 1 ) );
+
+   BOOST_REQUIRE( n > 0 );
+
+   std::vector<bancor_sampler::sample> issues, redeems, outputs;
+   for( uint64_t i = 0; i < n; ++i ) {
+      issues.push_back( sampler.issue() );
+      redeems.push_back( sampler.redeem() );
+      outputs.push_back( sampler.output() );
+   }
+
+   const struct { const char* name; bancor_fn fixed, floating; const std::vector<bancor_sampler::sample>& samples; } runs[] = {
+      { "convert_to_exchange",   fixed_issue,  double_issue,  issues  },
+      { "convert_from_exchange", fixed_redeem, double_redeem, redeems },
+      { "get_bancor_output",     fixed_output, double_output, outputs }
+   };
+
+   // native timings only rank the formulas; in the contract the doubles go through softfloat,
+   // see buyram_bench for the billed CPU of a RAM trade
+   for( const auto& r : runs ) {
+      const double fixed_ns    = time_per_call_ns( r.fixed, r.samples );
+      const double floating_ns = time_per_call_ns( r.floating, r.samples );
+      BOOST_TEST_MESSAGE( r.name << ": fixed " << fixed_ns << " ns, double " << floating_ns << " ns per call" );
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include "eosio.system_tester.hpp"
+
+namespace eosio_system {
+
+inline uint64_t bench_env( const char* var, uint64_t def ) {
+   const char* v = std::getenv( var );
+   return v && *v ? std::strtoull( v, nullptr, 10 ) : def;
+}
+
+inline std::string bench_env( const char* var ) {
+   const char* v = std::getenv( var );
+   return v ? std::string( v ) : std::string();
+}
+
+/**
+ * Returns the i-th name of a generated account class, `prefix` followed by four characters in
+ * base 31, which is enough for close to a million accounts per class.
+ */
+inline account_name bench_account( const std::string& prefix, uint32_t i ) {
+   static const std::string charmap( "12345abcdefghijklmnopqrstuvwxyz" );
+   std::string s( prefix );
+   for( int d = 3; d >= 0; --d ) {
+      uint32_t p = 1;
+      for( int k = 0; k < d; ++k ) p *= charmap.size();
+      s += charmap[ (i / p) % charmap.size() ];
+   }
+   return account_name( s );
+}
+
+/**
+ * Statistics of a class of measured transactions: billed CPU, wall time of the actions and net
+ * RAM delta of all the accounts touched by the transaction, including inline actions.
+ */
+struct action_stats {
+   vector<uint32_t> cpu_us;
+   uint64_t         elapsed_us = 0;
+   int64_t          ram_delta  = 0;
+   int64_t          ram_delta_max = std::numeric_limits<int64_t>::min();
+
+   static int64_t ram_deltas( const action_trace& at ) {
+      int64_t delta = 0;
+      for( const auto& d : at.account_ram_deltas ) {
+         delta += d.delta;
+      }
+      for( const auto& inl : at.inline_traces ) {
+         delta += ram_deltas( inl );
+      }
+      return delta;
+   }
+
+   void record( const transaction_trace_ptr& trace ) {
+      BOOST_REQUIRE( trace );
+      BOOST_REQUIRE( trace->receipt );
+      BOOST_REQUIRE_EQUAL( transaction_receipt::executed, trace->receipt->status );
+      cpu_us.push_back( trace->receipt->cpu_usage_us );
+      int64_t delta = 0;
+      for( const auto& at : trace->action_traces ) {
+         elapsed_us += at.elapsed.count();
+         delta += ram_deltas( at );
+      }
+      ram_delta += delta;
+      ram_delta_max = std::max( ram_delta_max, delta );
+   }
+
+   uint64_t total() const {
+      uint64_t t = 0;
+      for( auto c : cpu_us ) t += c;
+      return t;
+   }
+
+   fc::mutable_variant_object metrics() const {
+      vector<uint32_t> sorted( cpu_us );
+      std::sort( sorted.begin(), sorted.end() );
+      const uint64_t n = sorted.size();
+      if( n == 0 ) {
+         return mvo()("count", 0);
+      }
+      auto pct = [&]( uint32_t p ) { return sorted[ std::min<uint64_t>( n - 1, n * p / 100 ) ]; };
+      return mvo()
+         ("count",          n)
+         ("cpu_us_avg",     total() / n)
+         ("cpu_us_p50",     pct(50))
+         ("cpu_us_p95",     pct(95))
+         ("cpu_us_max",     sorted.back())
+         ("elapsed_us_avg", elapsed_us / n)
+         ("ram_delta_avg",  ram_delta / int64_t(n))
+         ("ram_delta_max",  ram_delta_max);
+   }
+};
+
+}
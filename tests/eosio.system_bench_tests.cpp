@@ -0,0 +1,181 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/resource_limits.hpp>
+#include <eosio/chain/wast_to_wasm.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <fc/log/logger.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <Runtime/Runtime.h>
+
+#include "eosio.system_tester.hpp"
+
+using namespace eosio_system;
+
+namespace {
+
+/**
+ * Accumulates the billed CPU, the measured wall time of the system contract actions and the global
+ * state rows written by the recorded transactions, so that hot paths can be compared across
+ * contract revisions.
+ */
+struct bench_sample {
+   uint64_t cpu_us        = 0;
+   uint64_t elapsed_us    = 0;
+   uint32_t global_writes = 0;
+   uint32_t count         = 0;
+
+   void record( const transaction_trace_ptr& trace, uint32_t writes ) {
+      BOOST_REQUIRE( trace );
+      BOOST_REQUIRE( trace->receipt );
+      BOOST_REQUIRE_EQUAL( transaction_receipt::executed, trace->receipt->status );
+      cpu_us += trace->receipt->cpu_usage_us;
+      for( const auto& at : trace->action_traces ) {
+         if( at.act.account == config::system_account_name ) {
+            elapsed_us += at.elapsed.count();
+         }
+      }
+      global_writes += writes;
+      ++count;
+   }
+
+   void report( const string& name ) const {
+      BOOST_REQUIRE( count > 0 );
+      BOOST_TEST_MESSAGE( name << ": " << count << " runs, avg billed cpu " << cpu_us / count
+                          << " us, avg system contract time " << elapsed_us / count << " us, "
+                          << double(global_writes) / count << " global rows written per run" );
+   }
+};
+
+/**
+ * Tells how many of the `global`, `global2` and `global3` rows changed since the last call, by
+ * comparing them with the contents seen then.
+ */
+struct global_rows {
+   explicit global_rows( eosio_system_tester& t ) : tester( t ) {
+      changed();
+   }
+
+   uint32_t changed() {
+      uint32_t n = 0;
+      for( auto table : { N(global), N(global2), N(global3) } ) {
+         auto data = tester.get_row_by_account( config::system_account_name, config::system_account_name, table, table );
+         if( data != rows[table] ) {
+            rows[table] = std::move( data );
+            ++n;
+         }
+      }
+      return n;
+   }
+
+   eosio_system_tester&               tester;
+   std::map<uint64_t, vector<char>>   rows;
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(eosio_system_bench_tests)
+
+BOOST_FIXTURE_TEST_CASE( onblock_bench, eosio_system_tester ) try {
+   active_and_vote_producers();
+
+   bench_sample onblock;
+   global_rows  globals( *this );
+   // the common path is every block that does not update the producer schedule
+   string   last_update = get_block_stats()["last_producer_schedule_update"].as_string();
+   uint32_t common_runs = 0, common_writes = 0;
+   auto c = control->applied_transaction.connect( [&]( const transaction_trace_ptr& t ) {
+      const uint32_t writes = globals.changed();
+      if( t && t->action_traces.size() > 0 && t->action_traces[0].act.name == N(onblock) ) {
+         onblock.record( t, writes );
+         const string update = get_block_stats()["last_producer_schedule_update"].as_string();
+         if( update == last_update ) {
+            ++common_runs;
+            common_writes += writes;
+         }
+         last_update = update;
+      }
+   });
+   produce_blocks( 500 );
+   c.disconnect();
+
+   onblock.report( "onblock" );
+   BOOST_REQUIRE( 0 < common_runs );
+   BOOST_REQUIRE_EQUAL( 0, common_writes );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( voteproducer_bench, eosio_system_tester ) try {
+   auto producer_names = active_and_vote_producers();
+
+   transfer( "eosio", "bob111111111", core_sym::from_string("10000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") ) );
+
+   bench_sample voteproducer;
+   global_rows  globals( *this );
+   for( int i = 0; i < 50; ++i ) {
+      // alternate between two sets, so that every vote moves weight across producers
+      auto first = producer_names.begin() + (i % 2);
+      vector<account_name> producers( first, first + 20 );
+      globals.changed();
+      auto trace = TESTER::push_action( config::system_account_name, N(voteproducer), N(bob111111111), mvo()
+                                        ("voter",     "bob111111111")
+                                        ("proxy",     name(0).to_string())
+                                        ("producers", producers) );
+      voteproducer.record( trace, globals.changed() );
+      produce_block();
+   }
+
+   voteproducer.report( "voteproducer (20 producers)" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( voteproducer_30_bench, eosio_system_tester ) try {
+   active_and_vote_producers();
+
+   // register the maximum number of producers a single vote may name, in sorted order
+   std::vector<account_name> producers;
+   for( char c : std::string("12345abcdefghijklmnopqrstuvwxy") ) {
+      producers.emplace_back( std::string("benchprod") + c );
+   }
+   setup_producer_accounts( producers );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+
+   transfer( "eosio", "bob111111111", core_sym::from_string("10000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") ) );
+
+   bench_sample voteproducer;
+   global_rows  globals( *this );
+   for( int i = 0; i < 50; ++i ) {
+      globals.changed();
+      auto trace = TESTER::push_action( config::system_account_name, N(voteproducer), N(bob111111111), mvo()
+                                        ("voter",     "bob111111111")
+                                        ("proxy",     name(0).to_string())
+                                        ("producers", producers) );
+      voteproducer.record( trace, globals.changed() );
+      produce_block();
+   }
+
+   voteproducer.report( "voteproducer (30 producers)" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( buyram_bench, eosio_system_tester ) try {
+   transfer( "eosio", "alice1111111", core_sym::from_string("10000.0000"), "eosio" );
+
+   bench_sample buyram;
+   global_rows  globals( *this );
+   for( int i = 0; i < 50; ++i ) {
+      globals.changed();
+      auto trace = TESTER::push_action( config::system_account_name, N(buyram), N(alice1111111), mvo()
+                                        ("payer",    "alice1111111")
+                                        ("receiver", "alice1111111")
+                                        ("quant",    core_sym::from_string("10.0000")) );
+      buyram.record( trace, globals.changed() );
+      produce_block();
+   }
+
+   buyram.report( "buyram" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
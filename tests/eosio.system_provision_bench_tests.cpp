@@ -0,0 +1,219 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/resource_limits.hpp>
+#include <eosio/chain/wast_to_wasm.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <Runtime/Runtime.h>
+
+#include "eosio.system_tester.hpp"
+#include "eosio.system_bench_helpers.hpp"
+
+/**
+ * Bulk provisioning benchmark.
+ *
+ * Provisions the accounts of a token snapshot with bulkprov and compares the billed CPU per
+ * account against one transaction of newaccount, buyrambytes, delegatebw and transfer per account.
+ *
+ * The snapshot is a CSV file with one account per line and amounts in core token units,
+ *
+ *   account,owner_key,active_key,ram_bytes,net,cpu,liquid
+ *   alice1111111,EOS6MRy...,EOS6MRy...,8000,10.0000,10.0000,125.5000
+ *
+ * where empty lines and lines starting with '#' are skipped. The run is configured through
+ * the environment:
+ *
+ *   EOSIO_BENCH_SNAPSHOT    path of the CSV snapshot (default: generated accounts and keys)
+ *   EOSIO_BENCH_ACCOUNTS    number of generated accounts (default 2000)
+ *   EOSIO_BENCH_BATCH       accounts per bulkprov action (default 25)
+ *   EOSIO_BENCH_BATCH_OUT   directory to write every batch to as the JSON data of a bulkprov
+ *                           action, e.g. for `cleos push action eosio bulkprov batch_00000.json`
+ */
+
+using namespace eosio_system;
+
+namespace {
+
+struct snapshot_account {
+   account_name account;
+   std::string  owner_key;
+   std::string  active_key;
+   uint32_t     ram_bytes = 0;
+   std::string  net;
+   std::string  cpu;
+   std::string  liquid;
+
+   fc::variant to_variant() const {
+      return fc::variant( mvo()
+                          ("account",    account)
+                          ("owner_key",  owner_key)
+                          ("active_key", active_key)
+                          ("ram_bytes",  ram_bytes)
+                          ("net",        core_sym::from_string(net))
+                          ("cpu",        core_sym::from_string(cpu))
+                          ("liquid",     core_sym::from_string(liquid)) );
+   }
+};
+
+vector<snapshot_account> load_snapshot( const std::string& path ) {
+   std::ifstream in( path );
+   BOOST_REQUIRE_MESSAGE( in, "cannot open snapshot " << path );
+
+   vector<snapshot_account> accounts;
+   std::string line;
+   for( uint32_t line_num = 1; std::getline( in, line ); ++line_num ) {
+      if( line.empty() || line[0] == '#' ) continue;
+
+      vector<std::string> fields;
+      std::stringstream ss( line );
+      for( std::string f; std::getline( ss, f, ',' ); ) {
+         fields.push_back( f );
+      }
+      BOOST_REQUIRE_MESSAGE( fields.size() == 7, path << ":" << line_num << ": expected 7 fields" );
+
+      snapshot_account a;
+      a.account    = account_name( fields[0] );
+      a.owner_key  = fields[1];
+      a.active_key = fields[2];
+      a.ram_bytes  = std::stoul( fields[3] );
+      a.net        = fields[4];
+      a.cpu        = fields[5];
+      a.liquid     = fields[6];
+      accounts.push_back( a );
+   }
+   return accounts;
+}
+
+vector<vector<fc::variant>> to_batches( const vector<snapshot_account>& accounts, uint32_t batch_size ) {
+   vector<vector<fc::variant>> batches;
+   for( size_t first = 0; first < accounts.size(); first += batch_size ) {
+      vector<fc::variant> batch;
+      for( size_t i = first; i < std::min( accounts.size(), first + batch_size ); ++i ) {
+         batch.push_back( accounts[i].to_variant() );
+      }
+      batches.push_back( std::move( batch ) );
+   }
+   return batches;
+}
+
+void write_batches( const std::string& dir, const vector<vector<fc::variant>>& batches ) {
+   for( size_t i = 0; i < batches.size(); ++i ) {
+      char file[32];
+      snprintf( file, sizeof(file), "/batch_%05zu.json", i );
+      std::ofstream out( dir + file );
+      BOOST_REQUIRE_MESSAGE( out, "cannot write " << dir << file );
+      out << fc::json::to_pretty_string( mvo()("accounts", batches[i]) ) << std::endl;
+   }
+}
+
+class provision_bench_tester : public eosio_system_tester {
+public:
+   const uint32_t batch_size = bench_env( "EOSIO_BENCH_BATCH", 25 );
+
+   vector<snapshot_account> generate_snapshot( const std::string& prefix, uint32_t n ) {
+      vector<snapshot_account> accounts;
+      for( uint32_t i = 0; i < n; ++i ) {
+         snapshot_account a;
+         a.account    = bench_account( prefix, i );
+         a.owner_key  = string( get_public_key( a.account, "owner" ) );
+         a.active_key = string( get_public_key( a.account, "active" ) );
+         a.ram_bytes  = 8000;
+         a.net        = "10.0000";
+         a.cpu        = "10.0000";
+         a.liquid     = "5.0000";
+         accounts.push_back( a );
+      }
+      return accounts;
+   }
+
+   transaction_trace_ptr push_measured( vector<action> acts ) {
+      signed_transaction trx;
+      trx.actions = std::move( acts );
+      set_transaction_headers( trx );
+      trx.sign( get_private_key( config::system_account_name, "active" ), control->get_chain_id() );
+      auto trace = push_transaction( trx, fc::time_point::maximum(), 0 );
+      produce_block();
+      BOOST_REQUIRE( trace && trace->receipt );
+      BOOST_REQUIRE_EQUAL( transaction_receipt::executed, trace->receipt->status );
+      return trace;
+   }
+
+   /// the per-account transaction a bootstrap script sends today
+   vector<action> single_account_actions( const snapshot_account& a ) {
+      const account_name creator = config::system_account_name;
+      const vector<permission_level> auth{{creator, config::active_name}};
+      vector<action> acts;
+      acts.emplace_back( auth, newaccount{
+                            .creator  = creator,
+                            .name     = a.account,
+                            .owner    = authority( public_key_type( a.owner_key ) ),
+                            .active   = authority( public_key_type( a.active_key ) )
+                         });
+      acts.emplace_back( get_action( config::system_account_name, N(buyrambytes), auth, mvo()
+                                     ("payer",    creator)
+                                     ("receiver", a.account)
+                                     ("bytes",    a.ram_bytes) ) );
+      acts.emplace_back( get_action( config::system_account_name, N(delegatebw), auth, mvo()
+                                     ("from",               creator)
+                                     ("receiver",           a.account)
+                                     ("stake_net_quantity", core_sym::from_string(a.net))
+                                     ("stake_cpu_quantity", core_sym::from_string(a.cpu))
+                                     ("transfer",           1) ) );
+      acts.emplace_back( get_action( N(eosio.token), N(transfer), auth, mvo()
+                                     ("from",     creator)
+                                     ("to",       a.account)
+                                     ("quantity", core_sym::from_string(a.liquid))
+                                     ("memo",     "") ) );
+      return acts;
+   }
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(eosio_system_provision_bench_tests)
+
+BOOST_FIXTURE_TEST_CASE( bulkprov_bench, provision_bench_tester ) try {
+   const std::string snapshot = bench_env( "EOSIO_BENCH_SNAPSHOT" );
+   const auto accounts = snapshot.empty() ? generate_snapshot( "prov", bench_env( "EOSIO_BENCH_ACCOUNTS", 2000 ) )
+                                          : load_snapshot( snapshot );
+   BOOST_REQUIRE( !accounts.empty() );
+
+   const auto batches = to_batches( accounts, batch_size );
+   const std::string out_dir = bench_env( "EOSIO_BENCH_BATCH_OUT" );
+   if( !out_dir.empty() ) {
+      write_batches( out_dir, batches );
+   }
+
+   uint64_t bulk_cpu_us = 0;
+   for( const auto& batch : batches ) {
+      bulk_cpu_us += push_measured( { get_action( config::system_account_name, N(bulkprov),
+                                                  {{config::system_account_name, config::active_name}},
+                                                  mvo()("accounts", batch) ) } )->receipt->cpu_usage_us;
+   }
+
+   const auto& last = accounts.back();
+   BOOST_REQUIRE_EQUAL( core_sym::from_string(last.liquid), get_balance( last.account ) );
+   const int64_t last_bytes = get_total_stake( last.account )["ram_bytes"].as_int64();
+   BOOST_REQUIRE( int64_t(last.ram_bytes) - 10 <= last_bytes && last_bytes <= int64_t(last.ram_bytes) );
+
+   // the same accounts, one transaction each, for a sample of the snapshot
+   const auto singles = generate_snapshot( "sing", std::min<uint32_t>( accounts.size(), 100 ) );
+   uint64_t single_cpu_us = 0;
+   for( const auto& a : singles ) {
+      single_cpu_us += push_measured( single_account_actions( a ) )->receipt->cpu_usage_us;
+   }
+
+   BOOST_TEST_MESSAGE( "bulkprov: " << accounts.size() << " accounts in " << batches.size() << " batches, "
+                       << bulk_cpu_us / accounts.size() << " us billed cpu per account" );
+   BOOST_TEST_MESSAGE( "per account transactions: " << singles.size() << " accounts, "
+                       << single_cpu_us / singles.size() << " us billed cpu per account" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,345 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/resource_limits.hpp>
+#include <eosio/chain/wast_to_wasm.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <Runtime/Runtime.h>
+
+#include "eosio.system_tester.hpp"
+#include "eosio.system_bench_helpers.hpp"
+
+/**
+ * REX loan expiry wave benchmark.
+ *
+ * Lenders fill the REX pool and renters take out CPU and NET loans in a few short waves, so that
+ * each wave expires within seconds 30 days later. Once their REX has matured the lenders sell all
+ * of it, which queues most of the sell orders behind the lent tokens. Time is then advanced to
+ * the expiry of every wave in turn and rexexec is cranked until the wave is processed; the queued
+ * orders fill as the expired loans return their tokens to the pool. Loans are rented without a
+ * fund, so none of them is renewed.
+ *
+ * Every rexexec is billed the CPU it actually used. The report records the CPU per processed
+ * loan, the rexexec calls that wrote the rexpool row, and the chain time and number of rexexec
+ * calls from the expiry of a wave until it was processed and from the start of the crank until
+ * each queued order was filled.
+ *
+ * The run is sized and configured through the environment:
+ *
+ *   EOSIO_BENCH_LOANS      CPU and NET loans rented (default 2000, the full run uses 40000)
+ *   EOSIO_BENCH_RENTERS    renter accounts (default 200)
+ *   EOSIO_BENCH_LENDERS    lender accounts, each buying 50000 tokens of REX (default 20)
+ *   EOSIO_BENCH_WAVES      expiry waves the loans are rented in (default 4)
+ *   EOSIO_BENCH_WAVE_GAP   seconds between two waves (default 21600)
+ *   EOSIO_BENCH_EXEC_MAX   max argument of every rexexec (default 50)
+ *   EOSIO_BENCH_SEED       seed of the choice between CPU and NET loans (default 1)
+ *   EOSIO_BENCH_REPORT     path of the JSON report to write
+ */
+
+using namespace eosio_system;
+
+namespace {
+
+/// a chain time difference in whole seconds
+int64_t seconds_between( const fc::time_point& from, const fc::time_point& to ) {
+   return (to - from).count() / 1000000;
+}
+
+class rex_bench_tester : public eosio_system_tester {
+public:
+   const uint32_t num_loans    = bench_env( "EOSIO_BENCH_LOANS", 2000 );
+   const uint32_t num_renters  = bench_env( "EOSIO_BENCH_RENTERS", 200 );
+   const uint32_t num_lenders  = bench_env( "EOSIO_BENCH_LENDERS", 20 );
+   const uint32_t num_waves    = bench_env( "EOSIO_BENCH_WAVES", 4 );
+   const uint32_t wave_gap_sec = bench_env( "EOSIO_BENCH_WAVE_GAP", 21600 );
+   const uint16_t exec_max     = bench_env( "EOSIO_BENCH_EXEC_MAX", 50 );
+
+   std::mt19937         rng{ uint32_t( bench_env( "EOSIO_BENCH_SEED", 1 ) ) };
+   const account_name   proxy = N(rexbenchprxy);
+   vector<account_name> renters;
+   vector<account_name> lenders;
+
+   /// the loans rent the initial total_rent of the pool once over, which lends out about half of it
+   const int64_t payment_amount = std::max<int64_t>( 1, 20000'0000 / std::max<uint32_t>( 1, num_loans ) );
+   const asset   lender_stake   = core_sym::from_string("50000.0000");
+
+   static constexpr uint32_t batch_size = 20;
+
+   struct wave {
+      uint32_t         loans = 0;
+      fc::time_point   expiration;     ///< expiration of the last loan of the wave
+      uint32_t         rexexec_calls = 0;
+      int64_t          drain_sec = 0;  ///< from expiration until the wave was processed
+      uint64_t         cpu_us = 0;
+   };
+
+   vector<wave>                 waves;
+   action_stats                 sellrex_stats;
+   action_stats                 rexexec_stats;
+   uint64_t                     loans_processed = 0;
+   uint32_t                     pool_writes = 0;
+   uint32_t                     orders_queued = 0;
+   std::map<account_name, bool> open_orders;
+   vector<int64_t>              order_wait_sec;
+   vector<uint32_t>             order_wait_calls;
+
+   void push_batch( vector<action> acts, const std::set<account_name>& signers ) {
+      signed_transaction trx;
+      trx.actions = std::move( acts );
+      set_transaction_headers( trx );
+      for( const auto& s : signers ) {
+         trx.sign( get_private_key( s, "active" ), control->get_chain_id() );
+      }
+      push_transaction( trx );
+      produce_block();
+   }
+
+   transaction_trace_ptr push_measured( const account_name& signer, const action_name& act, const variant_object& data ) {
+      signed_transaction trx;
+      trx.actions.emplace_back( get_action( config::system_account_name, act, vector<permission_level>{{signer, config::active_name}}, data ) );
+      set_transaction_headers( trx );
+      trx.sign( get_private_key( signer, "active" ), control->get_chain_id() );
+      auto trace = push_transaction( trx, fc::time_point::maximum(), 0 );
+      produce_block();
+      return trace;
+   }
+
+   /**
+    * Creates accounts funded by the system account and deposits `fund` into their REX fund;
+    * lenders also vote through the benchmark proxy and buy REX with the whole fund.
+    */
+   void create_rex_accounts( const vector<account_name>& accounts, const asset& fund, uint32_t ram_bytes, bool lend ) {
+      const account_name creator = config::system_account_name;
+      const vector<permission_level> auth{{creator, config::active_name}};
+      for( size_t first = 0; first < accounts.size(); first += batch_size / 4 ) {
+         vector<action> acts;
+         std::set<account_name> signers{ creator };
+         for( size_t i = first; i < std::min( accounts.size(), first + batch_size / 4 ); ++i ) {
+            const auto& a = accounts[i];
+            const vector<permission_level> own{{a, config::active_name}};
+            acts.emplace_back( auth, newaccount{
+                                  .creator  = creator,
+                                  .name     = a,
+                                  .owner    = authority( get_public_key( a, "owner" ) ),
+                                  .active   = authority( get_public_key( a, "active" ) )
+                               });
+            acts.emplace_back( get_action( config::system_account_name, N(buyrambytes), auth, mvo()
+                                           ("payer",    creator)
+                                           ("receiver", a)
+                                           ("bytes",    ram_bytes) ) );
+            acts.emplace_back( get_action( config::system_account_name, N(delegatebw), auth, mvo()
+                                           ("from",               creator)
+                                           ("receiver",           a)
+                                           ("stake_net_quantity", core_sym::from_string("10.0000"))
+                                           ("stake_cpu_quantity", core_sym::from_string("10.0000"))
+                                           ("transfer",           1) ) );
+            if( fund.get_amount() > 0 ) {
+               acts.emplace_back( get_action( N(eosio.token), N(transfer), auth, mvo()
+                                              ("from",     creator)
+                                              ("to",       a)
+                                              ("quantity", fund)
+                                              ("memo",     "") ) );
+               acts.emplace_back( get_action( config::system_account_name, N(deposit), own, mvo()("owner", a)("amount", fund) ) );
+            }
+            if( lend ) {
+               acts.emplace_back( get_action( config::system_account_name, N(voteproducer), own, mvo()
+                                              ("voter", a)("proxy", proxy)("producers", vector<account_name>()) ) );
+               acts.emplace_back( get_action( config::system_account_name, N(buyrex), own, mvo()("from", a)("amount", fund) ) );
+            }
+            signers.insert( a );
+         }
+         push_batch( std::move( acts ), signers );
+      }
+   }
+
+   void setup() {
+      for( uint32_t i = 0; i < num_renters; ++i ) renters.push_back( bench_account( "rexrentr", i ) );
+      for( uint32_t i = 0; i < num_lenders; ++i ) lenders.push_back( bench_account( "rexlendr", i ) );
+
+      create_rex_accounts( { proxy }, core_sym::from_string("0.0000"), 8000, false );
+      BOOST_REQUIRE_EQUAL( success(), push_action( proxy, N(regproxy), mvo()("proxy", proxy)("isproxy", true) ) );
+      create_rex_accounts( lenders, lender_stake, 8000, true );
+
+      // every loan row is paid for by its renter
+      const uint32_t loans_per_renter = ( num_loans + num_renters - 1 ) / num_renters;
+      create_rex_accounts( renters, asset( payment_amount * loans_per_renter, symbol{CORE_SYM} ),
+                           8000 + 300 * loans_per_renter, false );
+   }
+
+   void rent_waves() {
+      const asset payment( payment_amount, symbol{CORE_SYM} );
+      const uint32_t loans_per_wave = ( num_loans + num_waves - 1 ) / num_waves;
+      uint32_t rented = 0;
+      while( rented < num_loans ) {
+         wave w;
+         while( w.loans < loans_per_wave && rented < num_loans ) {
+            vector<action> acts;
+            std::set<account_name> signers;
+            for( uint32_t i = 0; i < batch_size && w.loans < loans_per_wave && rented < num_loans; ++i, ++w.loans, ++rented ) {
+               const auto& r = renters[ rented % renters.size() ];
+               const bool cpu = std::uniform_int_distribution<uint32_t>( 0, 1 )( rng ) == 0;
+               acts.emplace_back( get_action( config::system_account_name, cpu ? N(rentcpu) : N(rentnet),
+                                              {{r, config::active_name}}, mvo()
+                                              ("from",         r)
+                                              ("receiver",     r)
+                                              ("loan_payment", payment)
+                                              ("loan_fund",    core_sym::from_string("0.0000")) ) );
+               signers.insert( r );
+            }
+            push_batch( std::move( acts ), signers );
+         }
+         w.expiration = control->head_block_time() + fc::days(30);
+         waves.push_back( w );
+         produce_block( fc::seconds( wave_gap_sec ) );
+      }
+      BOOST_REQUIRE_EQUAL( num_loans, loan_rows() );
+   }
+
+   void queue_sell_orders() {
+      produce_block( fc::days(5) );
+      for( const auto& l : lenders ) {
+         sellrex_stats.record( push_measured( l, N(sellrex), mvo()("from", l)("rex", get_rex_balance( l )) ) );
+         const auto order = get_rex_order_obj( l );
+         const bool open = !order.is_null() && order["is_open"].as<bool>();
+         open_orders[l] = open;
+         if( open ) ++orders_queued;
+      }
+      BOOST_REQUIRE_MESSAGE( orders_queued > 0, "no sell orders were queued, rent more of the pool" );
+   }
+
+   uint32_t table_rows( const name& table ) const {
+      const auto* t_id = control->db().find<eosio::chain::table_id_object, eosio::chain::by_code_scope_table>(
+         boost::make_tuple( config::system_account_name, config::system_account_name, table ) );
+      return t_id ? t_id->count : 0;
+   }
+
+   uint32_t loan_rows() const {
+      return table_rows( N(cpuloan) ) + table_rows( N(netloan) );
+   }
+
+   /// records the orders filled by the last rexexec, `calls` rexexec calls into the crank
+   void check_filled_orders( uint32_t calls ) {
+      for( auto& o : open_orders ) {
+         if( !o.second ) continue;
+         const auto order = get_rex_order_obj( o.first );
+         if( order["is_open"].as<bool>() ) continue;
+         o.second = false;
+         order_wait_sec.push_back( seconds_between( order["order_time"].as<fc::time_point>(), control->head_block_time() ) );
+         order_wait_calls.push_back( calls );
+      }
+   }
+
+   uint32_t open_order_count() const {
+      return std::count_if( open_orders.begin(), open_orders.end(), []( const auto& o ) { return o.second; } );
+   }
+
+   void crank_waves() {
+      uint32_t calls = 0;
+      uint32_t loans_left = num_loans;
+      for( size_t i = 0; i < waves.size(); ++i ) {
+         auto& w = waves[i];
+         if( control->head_block_time() < w.expiration ) {
+            produce_block( w.expiration - control->head_block_time() );
+         }
+         loans_left -= w.loans;
+         const bool last = i + 1 == waves.size();
+         // a call processes up to exec_max loans of each kind and orders
+         for( uint32_t guard = 0; loan_rows() > loans_left || ( last && open_order_count() > 0 ); ++guard ) {
+            BOOST_REQUIRE_MESSAGE( guard <= num_loans + orders_queued, "rexexec made no progress on wave " << i );
+            const uint32_t rows = loan_rows();
+            const std::string pool = fc::json::to_string( get_rex_pool() );
+            auto trace = push_measured( config::system_account_name, N(rexexec), mvo()
+                                        ("user", config::system_account_name)
+                                        ("max",  exec_max) );
+            rexexec_stats.record( trace );
+            ++calls;
+            ++w.rexexec_calls;
+            w.cpu_us        += trace->receipt->cpu_usage_us;
+            loans_processed += rows - loan_rows();
+            if( pool != fc::json::to_string( get_rex_pool() ) ) ++pool_writes;
+            check_filled_orders( calls );
+         }
+         w.drain_sec = seconds_between( w.expiration, control->head_block_time() );
+      }
+      BOOST_REQUIRE_EQUAL( 0u, loan_rows() );
+      BOOST_REQUIRE_EQUAL( 0u, open_order_count() );
+   }
+
+   template<typename T>
+   static fc::mutable_variant_object distribution( vector<T> v ) {
+      if( v.empty() ) {
+         return mvo()("count", 0);
+      }
+      std::sort( v.begin(), v.end() );
+      int64_t total = 0;
+      for( auto x : v ) total += x;
+      return mvo()
+         ("count", v.size())
+         ("avg",   total / int64_t(v.size()))
+         ("p50",   v[ v.size() / 2 ])
+         ("max",   v.back());
+   }
+
+   fc::variant report() const {
+      vector<fc::variant> wave_reports;
+      for( const auto& w : waves ) {
+         wave_reports.push_back( fc::variant( mvo()
+            ("loans",         w.loans)
+            ("expiration",    w.expiration)
+            ("rexexec_calls", w.rexexec_calls)
+            ("drain_sec",     w.drain_sec)
+            ("cpu_us",        w.cpu_us) ) );
+      }
+      return mvo()
+         ("config", mvo()
+            ("loans",        num_loans)
+            ("renters",      num_renters)
+            ("lenders",      num_lenders)
+            ("waves",        num_waves)
+            ("wave_gap_sec", wave_gap_sec)
+            ("exec_max",     exec_max)
+            ("payment",      asset( payment_amount, symbol{CORE_SYM} )))
+         ("sellrex", sellrex_stats.metrics()
+            ("queued",       orders_queued))
+         ("rexexec", rexexec_stats.metrics()
+            ("loans_processed", loans_processed)
+            ("cpu_us_per_loan", loans_processed ? rexexec_stats.total() / loans_processed : 0)
+            ("pool_writes",     pool_writes))
+         ("order_drain", mvo()
+            ("wait_sec",      distribution( order_wait_sec ))
+            ("rexexec_calls", distribution( order_wait_calls )))
+         ("waves", wave_reports);
+   }
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(eosio_system_rex_bench_tests)
+
+BOOST_FIXTURE_TEST_CASE( rex_expiry_wave_bench, rex_bench_tester ) try {
+   setup();
+   rent_waves();
+   queue_sell_orders();
+   crank_waves();
+
+   BOOST_REQUIRE_EQUAL( num_loans, loans_processed );
+   BOOST_REQUIRE_EQUAL( orders_queued, order_wait_sec.size() );
+
+   const auto rep = report();
+   BOOST_TEST_MESSAGE( fc::json::to_pretty_string( rep ) );
+
+   const auto report_path = bench_env( "EOSIO_BENCH_REPORT" );
+   if( !report_path.empty() ) {
+      fc::json::save_to_file( rep, fc::path( report_path ), true );
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,299 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/resource_limits.hpp>
+#include <eosio/chain/wast_to_wasm.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <Runtime/Runtime.h>
+
+#include "eosio.system_tester.hpp"
+#include "eosio.system_bench_helpers.hpp"
+
+/**
+ * Voting scale benchmark.
+ *
+ * Builds a synthetic electorate of producers, proxies and voters on top of the regular
+ * `eosio_system_tester` setup, runs a seeded mix of vote and stake churn against it and
+ * records the billed CPU and the RAM delta of every measured action.
+ *
+ * The run is sized and configured through the environment:
+ *
+ *   EOSIO_BENCH_PRODUCERS      registered producers (default 200)
+ *   EOSIO_BENCH_PROXIES        registered proxies (default 20)
+ *   EOSIO_BENCH_VOTERS         regular voters (default 1000, the full scale run uses 100000)
+ *   EOSIO_BENCH_PROXIED        percentage of the voters that delegate to a proxy (default 50)
+ *   EOSIO_BENCH_CHURN          number of measured churn actions (default 500)
+ *   EOSIO_BENCH_SEED           seed of the churn generator (default 1)
+ *   EOSIO_BENCH_LAZY_PROXIES   when set, enables lazy proxy weight propagation with the given vote
+ *                              weight as the threshold for applying pending weight right away
+ *   EOSIO_BENCH_COMPACT_VOTES  when set to 1, enables the compact producer vote encoding
+ *   EOSIO_BENCH_REPORT         path of the JSON report to write
+ *   EOSIO_BENCH_THRESHOLDS     path of a JSON file with regression thresholds
+ *
+ * The thresholds file maps action names to the upper bounds of any of the reported metrics, e.g.
+ *
+ *   { "voteproducer": { "cpu_us_p95": 1500, "ram_delta_max": 512 },
+ *     "onblock":      { "cpu_us_avg": 400 } }
+ *
+ * and the test fails for every metric that exceeds its bound.
+ */
+
+using namespace eosio_system;
+
+namespace {
+
+class scale_bench_tester : public eosio_system_tester {
+public:
+   const uint32_t num_producers = bench_env( "EOSIO_BENCH_PRODUCERS", 200 );
+   const uint32_t num_proxies   = bench_env( "EOSIO_BENCH_PROXIES", 20 );
+   const uint32_t num_voters    = bench_env( "EOSIO_BENCH_VOTERS", 1000 );
+   const uint32_t pct_proxied   = bench_env( "EOSIO_BENCH_PROXIED", 50 );
+   const uint32_t num_churn     = bench_env( "EOSIO_BENCH_CHURN", 500 );
+
+   std::mt19937                        rng{ uint32_t( bench_env( "EOSIO_BENCH_SEED", 1 ) ) };
+   vector<account_name>                producers;
+   vector<account_name>                proxies;
+   vector<account_name>                voters;
+   std::map<std::string, action_stats> stats;
+
+   static constexpr uint32_t batch_size = 25;
+
+   /**
+    * Pushes a single action signed by `signer` and bills the CPU it actually used, rather than
+    * the fixed amount the tester bills by default.
+    */
+   transaction_trace_ptr push_measured( const account_name& signer, const action_name& act, const variant_object& data ) {
+      signed_transaction trx;
+      trx.actions.emplace_back( get_action( config::system_account_name, act, vector<permission_level>{{signer, config::active_name}}, data ) );
+      set_transaction_headers( trx );
+      trx.sign( get_private_key( signer, "active" ), control->get_chain_id() );
+      return push_transaction( trx, fc::time_point::maximum(), 0 );
+   }
+
+   void push_batch( vector<action> acts, const std::set<account_name>& signers ) {
+      signed_transaction trx;
+      trx.actions = std::move( acts );
+      set_transaction_headers( trx );
+      for( const auto& s : signers ) {
+         trx.sign( get_private_key( s, "active" ), control->get_chain_id() );
+      }
+      push_transaction( trx );
+      produce_block();
+   }
+
+   void create_electorate_accounts( const vector<account_name>& accounts ) {
+      const account_name creator = config::system_account_name;
+      const vector<permission_level> auth{{creator, config::active_name}};
+      for( size_t first = 0; first < accounts.size(); first += batch_size ) {
+         vector<action> acts;
+         for( size_t i = first; i < std::min( accounts.size(), first + batch_size ); ++i ) {
+            const auto& a = accounts[i];
+            acts.emplace_back( auth, newaccount{
+                                  .creator  = creator,
+                                  .name     = a,
+                                  .owner    = authority( get_public_key( a, "owner" ) ),
+                                  .active   = authority( get_public_key( a, "active" ) )
+                               });
+            acts.emplace_back( get_action( config::system_account_name, N(buyrambytes), auth, mvo()
+                                           ("payer",    creator)
+                                           ("receiver", a)
+                                           ("bytes",    8000) ) );
+            acts.emplace_back( get_action( config::system_account_name, N(delegatebw), auth, mvo()
+                                           ("from",               creator)
+                                           ("receiver",           a)
+                                           ("stake_net_quantity", core_sym::from_string("500.0000"))
+                                           ("stake_cpu_quantity", core_sym::from_string("500.0000"))
+                                           ("transfer",           1) ) );
+         }
+         push_batch( std::move( acts ), {creator} );
+      }
+   }
+
+   /// a random, sorted selection of up to 30 registered producers
+   vector<account_name> random_producers() {
+      const size_t count = std::uniform_int_distribution<size_t>( 1, std::min<size_t>( 30, producers.size() ) )( rng );
+      vector<account_name> pool( producers );
+      for( size_t i = 0; i < count; ++i ) {
+         std::swap( pool[i], pool[ std::uniform_int_distribution<size_t>( i, pool.size() - 1 )( rng ) ] );
+      }
+      pool.resize( count );
+      std::sort( pool.begin(), pool.end() );
+      return pool;
+   }
+
+   template<typename Container>
+   const account_name& pick( const Container& c ) {
+      return c[ std::uniform_int_distribution<size_t>( 0, c.size() - 1 )( rng ) ];
+   }
+
+   mvo vote_args( const account_name& voter, const account_name& proxy, const vector<account_name>& prods ) {
+      return mvo()("voter", voter)("proxy", proxy)("producers", prods);
+   }
+
+   void build_electorate() {
+      active_and_vote_producers();
+
+      const auto lazy_threshold = bench_env( "EOSIO_BENCH_LAZY_PROXIES" );
+      if( !lazy_threshold.empty() ) {
+         BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setproxyprop), mvo()
+                                                      ("lazy", true)("threshold", std::strtod( lazy_threshold.c_str(), nullptr )) ) );
+      }
+      if( bench_env( "EOSIO_BENCH_COMPACT_VOTES", 0 ) ) {
+         BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setvoteenc), mvo()("compact", true) ) );
+      }
+
+      for( uint32_t i = 0; i < num_producers; ++i ) producers.push_back( bench_account( "bnchprod", i ) );
+      for( uint32_t i = 0; i < num_proxies; ++i )   proxies.push_back( bench_account( "bnchprxy", i ) );
+      for( uint32_t i = 0; i < num_voters; ++i )    voters.push_back( bench_account( "bnchvotr", i ) );
+
+      for( size_t first = 0; first < producers.size(); first += batch_size ) {
+         setup_producer_accounts( vector<account_name>( producers.begin() + first,
+                                                        producers.begin() + std::min( producers.size(), first + batch_size ) ) );
+         produce_block();
+      }
+      for( const auto& p : producers ) {
+         BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+      }
+      produce_block();
+
+      create_electorate_accounts( proxies );
+      create_electorate_accounts( voters );
+
+      for( const auto& p : proxies ) {
+         push_batch( { get_action( config::system_account_name, N(regproxy), {{p, config::active_name}}, mvo()("proxy", p)("isproxy", true) ),
+                       get_action( config::system_account_name, N(voteproducer), {{p, config::active_name}},
+                                   vote_args( p, name(0), random_producers() ) ) },
+                     {p} );
+      }
+
+      for( size_t first = 0; first < voters.size(); first += batch_size ) {
+         vector<action> acts;
+         std::set<account_name> signers;
+         for( size_t i = first; i < std::min( voters.size(), first + batch_size ); ++i ) {
+            const auto& v = voters[i];
+            const bool proxied = !proxies.empty() && std::uniform_int_distribution<uint32_t>( 0, 99 )( rng ) < pct_proxied;
+            acts.emplace_back( get_action( config::system_account_name, N(voteproducer), {{v, config::active_name}},
+                                           proxied ? vote_args( v, pick( proxies ), {} ) : vote_args( v, name(0), random_producers() ) ) );
+            signers.insert( v );
+         }
+         push_batch( std::move( acts ), signers );
+      }
+   }
+
+   /**
+    * One measured churn step: a voter or a proxy changes its vote, or stake is added to or
+    * removed from a voter, which moves its weight across all the producers it votes for.
+    */
+   void churn_step() {
+      const uint32_t roll = std::uniform_int_distribution<uint32_t>( 0, 99 )( rng );
+      if( roll < 30 ) {
+         const auto& v = pick( voters );
+         const bool proxied = !proxies.empty() && roll < 30 * pct_proxied / 100;
+         stats["voteproducer"].record( push_measured( v, N(voteproducer),
+                                                      proxied ? vote_args( v, pick( proxies ), {} ) : vote_args( v, name(0), random_producers() ) ) );
+      } else if( roll < 40 && !proxies.empty() ) {
+         const auto& p = pick( proxies );
+         stats["voteproducer_proxy"].record( push_measured( p, N(voteproducer), vote_args( p, name(0), random_producers() ) ) );
+      } else if( roll < 75 ) {
+         stats["delegatebw"].record( push_measured( config::system_account_name, N(delegatebw), mvo()
+                                                    ("from",               config::system_account_name)
+                                                    ("receiver",           pick( voters ))
+                                                    ("stake_net_quantity", core_sym::from_string("1.0000"))
+                                                    ("stake_cpu_quantity", core_sym::from_string("1.0000"))
+                                                    ("transfer",           1) ) );
+      } else {
+         const auto& v = pick( voters );
+         stats["undelegatebw"].record( push_measured( v, N(undelegatebw), mvo()
+                                                      ("from",                 v)
+                                                      ("receiver",             v)
+                                                      ("unstake_net_quantity", core_sym::from_string("0.5000"))
+                                                      ("unstake_cpu_quantity", core_sym::from_string("0.5000")) ) );
+      }
+   }
+
+   void run_churn() {
+      auto c = control->applied_transaction.connect( [&]( const transaction_trace_ptr& t ) {
+         if( t && t->action_traces.size() > 0 && t->action_traces[0].act.name == N(onblock) ) {
+            stats["onblock"].record( t );
+         }
+      });
+      for( uint32_t i = 0; i < num_churn; ++i ) {
+         churn_step();
+         if( i % 10 == 9 ) produce_block();
+      }
+      produce_block();
+      c.disconnect();
+   }
+
+   void run_claims() {
+      produce_block( fc::days(1) );
+      produce_blocks( 10 );
+      for( const auto& p : producers ) {
+         stats["claimrewards"].record( push_measured( p, N(claimrewards), mvo()("owner", p) ) );
+      }
+   }
+
+   fc::variant report() const {
+      mvo actions;
+      for( const auto& s : stats ) {
+         actions( s.first, s.second.metrics() );
+      }
+      return mvo()
+         ("config", mvo()
+            ("producers",      num_producers)
+            ("proxies",        num_proxies)
+            ("voters",         num_voters)
+            ("proxied_pct",    pct_proxied)
+            ("churn",          num_churn)
+            ("lazy_proxies",   bench_env( "EOSIO_BENCH_LAZY_PROXIES" ))
+            ("compact_votes",  bench_env( "EOSIO_BENCH_COMPACT_VOTES", 0 ) != 0))
+         ("actions", actions);
+   }
+
+   void check_thresholds( const fc::variant& rep, const fc::variant& thresholds ) const {
+      const auto& actions = rep["actions"].get_object();
+      for( const auto& a : thresholds.get_object() ) {
+         BOOST_REQUIRE_MESSAGE( actions.contains( a.key().c_str() ), "no measurements for " << a.key() );
+         const auto& measured = actions[a.key()].get_object();
+         for( const auto& limit : a.value().get_object() ) {
+            BOOST_REQUIRE_MESSAGE( measured.contains( limit.key().c_str() ), "unknown metric " << a.key() << "." << limit.key() );
+            const int64_t value = measured[limit.key()].as_int64();
+            BOOST_CHECK_MESSAGE( value <= limit.value().as_int64(),
+                                 a.key() << "." << limit.key() << " regressed: " << value << " > " << limit.value().as_int64() );
+         }
+      }
+   }
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(eosio_system_scale_bench_tests)
+
+BOOST_FIXTURE_TEST_CASE( voting_scale_bench, scale_bench_tester ) try {
+   build_electorate();
+   run_churn();
+   run_claims();
+
+   const auto rep = report();
+   BOOST_TEST_MESSAGE( fc::json::to_pretty_string( rep ) );
+
+   const auto report_path = bench_env( "EOSIO_BENCH_REPORT" );
+   if( !report_path.empty() ) {
+      fc::json::save_to_file( rep, fc::path( report_path ), true );
+   }
+
+   const auto thresholds_path = bench_env( "EOSIO_BENCH_THRESHOLDS" );
+   if( !thresholds_path.empty() ) {
+      check_thresholds( rep, fc::json::from_file( fc::path( thresholds_path ) ) );
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
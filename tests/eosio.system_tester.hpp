@@ -433,6 +433,35 @@ public:
       return output;
    }
 
+   transaction_trace_ptr push_quoted( const account_name& signer, const action_name& quote, const variant_object& quote_data,
+                                      const action_name& act, const variant_object& act_data ) {
+      const vector<permission_level> auth{ { signer, config::active_name } };
+      signed_transaction trx;
+      trx.actions.emplace_back( get_action( config::system_account_name, quote, auth, quote_data ) );
+      trx.actions.emplace_back( get_action( config::system_account_name, act, auth, act_data ) );
+      set_transaction_headers( trx );
+      trx.sign( get_private_key( signer, "active" ), control->get_chain_id() );
+      auto trace = push_transaction( trx );
+      produce_block();
+      return trace;
+   }
+
+   std::pair<asset, asset> get_quote_result( const transaction_trace_ptr& trace ) {
+      std::pair<asset, asset> output;
+      for ( size_t i = 0; i < trace->action_traces.size(); ++i ) {
+         for ( size_t j = 0; j < trace->action_traces[i].inline_traces.size(); ++j ) {
+            if ( trace->action_traces[i].inline_traces[j].act.name == N(quoteresult) ) {
+               fc::datastream<const char*> ds( trace->action_traces[i].inline_traces[j].act.data.data(),
+                                               trace->action_traces[i].inline_traces[j].act.data.size() );
+               fc::raw::unpack( ds, output.first );
+               fc::raw::unpack( ds, output.second );
+               return output;
+            }
+         }
+      }
+      return output;
+   }
+
    action_result cancelrexorder( const account_name& owner ) {
       return push_action( name(owner), N(cnclrexorder), mvo()("owner", owner) );
    }
@@ -754,6 +783,25 @@ public:
       return abi_ser.binary_to_variant( "producer_info2", data, abi_serializer_max_time );
    }
 
+   fc::variant get_producer_bonus( const account_name& act ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(bonusindex), act );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "producer_bonus_index", data, abi_serializer_max_time );
+   }
+
+   // stores a packed row as is in a system contract table, by running the `setrow` test contract
+   // for one action, and then `system_wasm` again
+   void set_system_row( const name& table, const vector<char>& row, const vector<uint8_t>& system_wasm ) {
+      set_code( config::system_account_name, contracts::util::setrow_wast().c_str() );
+      action act;
+      act.account = config::system_account_name;
+      act.name    = N(setrow);
+      act.data    = fc::raw::pack( table );
+      act.data.insert( act.data.end(), row.begin(), row.end() );
+      BOOST_REQUIRE_EQUAL( success(), base_tester::push_action( std::move(act), uint64_t(config::system_account_name) ) );
+      set_code( config::system_account_name, system_wasm );
+      produce_blocks();
+   }
+
    void create_currency( name contract, name manager, asset maxsupply ) {
       auto act =  mutable_variant_object()
          ("issuer",       manager )
@@ -802,6 +850,20 @@ public:
       return static_cast<uint64_t>( time_point::from_iso_string( v.as_string() ).time_since_epoch().count() );
    }
 
+   fc::variant get_icp_metrics( const account_name& icp ) const {
+      vector<char> data = get_row_by_account( icp, icp, N(icpmetrics), N(icpmetrics) );
+      if( data.empty() ) return fc::variant();
+      const auto& accnt = control->db().get<account_object,by_name>( icp );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      abi_serializer icp_abi_ser(abi, abi_serializer_max_time);
+      return icp_abi_ser.binary_to_variant( "icp_metrics", data, abi_serializer_max_time );
+   }
+
+   string dump_icp_metrics( const account_name& icp ) const {
+      return fc::json::to_pretty_string( get_icp_metrics( icp ) );
+   }
+
    fc::variant get_global_state() {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global), N(global) );
       if (data.empty()) std::cout << "\nData is empty\n" << std::endl;
@@ -813,6 +875,12 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state2", data, abi_serializer_max_time );
    }
 
+   /// source of truth for `last_block_num`, `last_producer_schedule_update`, `last_name_close` and `total_unpaid_blocks`
+   fc::variant get_block_stats() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(blockstats), N(blockstats) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_block_stats", data, abi_serializer_max_time );
+   }
+
    fc::variant get_global_state3() {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global3), N(global3) );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state3", data, abi_serializer_max_time );
@@ -121,6 +121,119 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( buyrammulti, eosio_system_tester ) try {
+
+   const vector<std::pair<account_name, uint32_t>> purchases = {
+      { N(alice1111111), 10000 }, { N(bob111111111), 25000 }, { N(alice1111111), 4000 }, { N(carol1111111), 120 }
+   };
+   auto to_variant = [&]() {
+      vector<fc::variant> v;
+      for( const auto& p : purchases ) {
+         v.push_back( mvo()("receiver", p.first)("bytes", p.second) );
+      }
+      return v;
+   };
+   auto ram_market = []( eosio_system_tester& t ) {
+      return t.get_row_by_account( config::system_account_name, config::system_account_name, N(rammarket),
+                                   symbol(SY(4,RAMCORE)).value() );
+   };
+
+   // a second chain with the same history buys the same bytes with buyrambytes in one transaction;
+   // new_ram_per_block is 0, so the supply update that buyrambytes prices its first entry before is a no-op
+   eosio_system_tester sequential;
+   for( eosio_system_tester* t : { static_cast<eosio_system_tester*>(this), &sequential } ) {
+      t->transfer( "eosio", "alice1111111", core_sym::from_string("1000.0000"), "eosio" );
+   }
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of alice1111111"),
+                        push_action( N(bob111111111), N(buyrammulti), mvo()("payer", "alice1111111")("purchases", to_variant()) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no ram purchases"),
+                        push_action( N(alice1111111), N(buyrammulti), mvo()("payer", "alice1111111")("purchases", vector<fc::variant>()) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( N(alice1111111), N(buyrammulti), mvo()("payer", "alice1111111")("purchases", to_variant()) ) );
+
+   signed_transaction trx;
+   sequential.set_transaction_headers( trx );
+   for( const auto& p : purchases ) {
+      trx.actions.emplace_back( sequential.get_action( config::system_account_name, N(buyrambytes),
+                                                       { {N(alice1111111), config::active_name} },
+                                                       mvo()("payer", "alice1111111")("receiver", p.first)("bytes", p.second) ) );
+   }
+   trx.sign( sequential.get_private_key( N(alice1111111), "active" ), sequential.control->get_chain_id() );
+   sequential.push_transaction( trx );
+   sequential.produce_block();
+
+   for( auto a : { N(alice1111111), N(bob111111111), N(carol1111111) } ) {
+      BOOST_REQUIRE_EQUAL( sequential.get_total_stake( a )["ram_bytes"].as_int64(), get_total_stake( a )["ram_bytes"].as_int64() );
+   }
+   BOOST_REQUIRE_EQUAL( sequential.get_balance( "alice1111111" ), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( sequential.get_balance( "eosio.ram" ), get_balance( "eosio.ram" ) );
+   BOOST_REQUIRE_EQUAL( sequential.get_balance( "eosio.ramfee" ), get_balance( "eosio.ramfee" ) );
+   BOOST_REQUIRE( ram_market( sequential ) == ram_market( *this ) );
+   BOOST_REQUIRE_EQUAL( sequential.get_global_state()["total_ram_bytes_reserved"].as_uint64(),
+                        get_global_state()["total_ram_bytes_reserved"].as_uint64() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bulkprov, eosio_system_tester ) try {
+
+   auto entry = [&]( const account_name& a, uint32_t ram_bytes, const char* net, const char* cpu, const char* liquid ) {
+      return fc::variant( mvo()
+                          ("account",    a)
+                          ("owner_key",  get_public_key( a, "owner" ))
+                          ("active_key", get_public_key( a, "active" ))
+                          ("ram_bytes",  ram_bytes)
+                          ("net",        core_sym::from_string(net))
+                          ("cpu",        core_sym::from_string(cpu))
+                          ("liquid",     core_sym::from_string(liquid)) );
+   };
+   const vector<fc::variant> batch = {
+      entry( N(provision111), 8000, "10.0000", "20.0000", "5.0000" ),
+      entry( N(provision112), 4000, "0.0000",  "0.0000",  "1.0000" )
+   };
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(alice1111111), N(bulkprov), mvo()("accounts", batch) ) );
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(alice1111111), N(bulkprovres), mvo()("accounts", batch) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no accounts to provision"),
+                        push_action( config::system_account_name, N(bulkprov), mvo()("accounts", vector<fc::variant>()) ) );
+
+   const asset    stake_before    = get_balance( N(eosio.stake) );
+   const uint64_t reserved_before = get_global_state()["total_ram_bytes_reserved"].as_uint64();
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(bulkprov), mvo()("accounts", batch) ) );
+
+   auto total = get_total_stake( "provision111" );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), total["net_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("20.0000"), total["cpu_weight"].as<asset>() );
+   // each account gets the bytes its purchase converts to, which rounding may leave a little short
+   const int64_t bytes_111 = total["ram_bytes"].as_int64();
+   BOOST_REQUIRE( 8000 - 10 <= bytes_111 && bytes_111 <= 8000 );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), get_dbw_obj( "provision111", "provision111" )["net_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("30.0000").get_amount(), get_voter_info( "provision111" )["staked"].as_int64() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("5.0000"), get_balance( "provision111" ) );
+
+   total = get_total_stake( "provision112" );
+   const int64_t bytes_112 = total["ram_bytes"].as_int64();
+   BOOST_REQUIRE( 4000 - 10 <= bytes_112 && bytes_112 <= 4000 );
+   BOOST_REQUIRE( get_dbw_obj( "provision112", "provision112" ).is_null() );
+   BOOST_REQUIRE( get_voter_info( "provision112" ).is_null() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1.0000"), get_balance( "provision112" ) );
+
+   BOOST_REQUIRE_EQUAL( stake_before + core_sym::from_string("30.0000"), get_balance( N(eosio.stake) ) );
+   BOOST_REQUIRE_EQUAL( reserved_before + bytes_111 + bytes_112, get_global_state()["total_ram_bytes_reserved"].as_uint64() );
+
+   int64_t ram_bytes, net_weight, cpu_weight;
+   control->get_resource_limits_manager().get_account_limits( N(provision111), ram_bytes, net_weight, cpu_weight );
+   BOOST_REQUIRE_EQUAL( bytes_111 + 1400, ram_bytes ); // ram_gift_bytes
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000").get_amount(), net_weight );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("20.0000").get_amount(), cpu_weight );
+
+   // the accounts are controlled by their keys and can use their resources right away
+   BOOST_REQUIRE_EQUAL( success(), stake( "provision111", "provision111", core_sym::from_string("1.0000"), core_sym::from_string("1.0000") ) );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( stake_unstake, eosio_system_tester ) try {
    cross_15_percent_threshold();
 
@@ -186,6 +299,70 @@ BOOST_FIXTURE_TEST_CASE( stake_unstake, eosio_system_tester ) try {
    BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "alice1111111" ) );
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( refund_queue, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+
+   auto setrefundq = [&]( const account_name& signer, bool enabled, uint16_t crank_batch ) {
+      return push_action( signer, N(setrefundq), mvo()("enabled", enabled)("crank_batch", crank_batch) );
+   };
+   auto payrefunds = [&]( const account_name& caller, uint16_t max, const std::vector<account_name>& owners = {} ) {
+      return push_action( caller, N(payrefunds), mvo()("caller", caller)("max", max)("owners", owners) );
+   };
+   const auto net = core_sym::from_string("200.0000");
+   const auto cpu = core_sym::from_string("100.0000");
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"), setrefundq( N(alice1111111), true, 1 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("crank_batch must be positive"), setrefundq( config::system_account_name, true, 0 ) );
+   BOOST_REQUIRE_EQUAL( success(), setrefundq( config::system_account_name, true, 1 ) );
+
+   for( auto a : { N(alice1111111), N(bob111111111), N(carol1111111) } ) {
+      transfer( "eosio", a, core_sym::from_string("1000.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( a, a, net, cpu ) );
+   }
+   BOOST_REQUIRE_EQUAL( success(), unstake( "alice1111111", "alice1111111", net, cpu ) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "bob111111111", "bob111111111", net, cpu ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("max must be positive"), payrefunds( N(carol1111111), 0 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), payrefunds( N(carol1111111), 5 ) );
+
+   produce_block( fc::days(1) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "carol1111111", "carol1111111", net, cpu ) );
+   produce_block( fc::days(2) );
+   produce_blocks(1);
+
+   // no deferred refund transaction was scheduled for the matured refunds
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "bob111111111" ) );
+
+   // crank_batch bounds each call, the earliest refund is paid first
+   BOOST_REQUIRE_EQUAL( success(), payrefunds( N(carol1111111), 5 ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "bob111111111" ) );
+   BOOST_REQUIRE( get_refund_request( "alice1111111" ).is_null() );
+
+   // the caller may name the owners to pay instead, to get past one that cannot be paid
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), payrefunds( N(carol1111111), 5, { N(carol1111111) } ) );
+   BOOST_REQUIRE_EQUAL( success(), payrefunds( N(carol1111111), 5, { N(carol1111111), N(bob111111111) } ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "bob111111111" ) );
+   BOOST_REQUIRE( get_refund_request( "bob111111111" ).is_null() );
+
+   // owners can still claim manually, which removes their queue entry
+   produce_block( fc::days(1) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(refund), mvo()("owner", "carol1111111") ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "carol1111111" ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), payrefunds( N(carol1111111), 5 ) );
+
+   // nothing pays queued refunds on its own, neither deferred transactions nor onblock
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", "alice1111111", net, cpu ) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "alice1111111", "alice1111111", net, cpu ) );
+   produce_block( fc::days(3) );
+   produce_blocks( 250 );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( success(), payrefunds( N(carol1111111), 5 ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE( get_refund_request( "alice1111111" ).is_null() );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( stake_unstake_with_transfer, eosio_system_tester ) try {
    cross_15_percent_threshold();
 
@@ -1191,6 +1368,216 @@ BOOST_FIXTURE_TEST_CASE( proxy_actions_affect_producers, eosio_system_tester, *
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( lazy_proxy_propagation, eosio_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   cross_15_percent_threshold();
+
+   create_accounts_with_resources( {  N(defproducer1), N(defproducer2) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2) );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(regproxy), mvo()
+                                                ("proxy",  "alice1111111")
+                                                ("isproxy", true)
+                        )
+   );
+   issue( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0002"), core_sym::from_string("50.0001") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), vector<account_name>(), N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1), N(defproducer2) } ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("150.0003")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no pending proxies"),
+                        push_action( N(bob111111111), N(propproxies), mvo()("max", 10) ) );
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(alice1111111), N(setproxyprop), mvo()
+                                     ("lazy", true)
+                                     ("threshold", stake2votes(core_sym::from_string("100.0000")))
+                        )
+   );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setproxyprop), mvo()
+                                                ("lazy", true)
+                                                ("threshold", stake2votes(core_sym::from_string("100.0000")))
+                        )
+   );
+
+   //a delegator's stake change below the threshold is only recorded on the proxy
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("30.0001"), core_sym::from_string("20.0001") ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("150.0003")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("150.0003")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+
+   //the crank applies the pending weight
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(propproxies), mvo()("max", 10) ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no pending proxies"),
+                        push_action( N(bob111111111), N(propproxies), mvo()("max", 10) ) );
+
+   //so does a vote of the proxy itself
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1) } ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("220.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+
+   //a change above the threshold still propagates right away
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("420.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( voter_bonus_claims, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+
+   create_accounts_with_resources( {  N(defproducer1), N(defproducer2) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(regproxy), mvo()
+                                                ("proxy",  "alice1111111")
+                                                ("isproxy", true)
+                        )
+   );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer2) } ) );
+
+   issue( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1) } ) );
+
+   const asset initial_bob_balance  = get_balance( "bob111111111" );
+   const asset initial_vpay_balance = get_balance( N(eosio.vpay) );
+   const std::string claim_error = "no voter bonus to claim";
+
+   //staking right before a claim does not get paid for past bonus
+   produce_block( fc::hours(24) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("500.0000"), core_sym::from_string("0.0000") ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( claim_error ), push_action( N(bob111111111), N(claimbonus), mvo()("owner", "bob111111111") ) );
+
+   //neither does moving to a proxy, nor a stake change of the proxied voter
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), vector<account_name>(), N(alice1111111) ) );
+   produce_block( fc::hours(24) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("0.0000") ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( claim_error ), push_action( N(bob111111111), N(claimbonus), mvo()("owner", "bob111111111") ) );
+
+   //the voter bonus rate is 0 in this build, so nothing is ever settled or paid
+   BOOST_REQUIRE_EQUAL( initial_bob_balance - core_sym::from_string("600.0000"), get_balance( "bob111111111" ) );
+   BOOST_REQUIRE_EQUAL( initial_vpay_balance, get_balance( N(eosio.vpay) ) );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(bonusacct), N(bob111111111) ).empty() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( voter_bonus_rate_claims, eosio_system_tester ) try {
+   // the test build pays a fifth of the producer vote pay to voters
+   const auto bonus_wasm = contracts::util::system_bonus_wasm();
+   set_code( config::system_account_name, bonus_wasm );
+   produce_blocks();
+
+   const asset large_asset = core_sym::from_string("80.0000");
+   for ( auto a : { N(defproducera), N(defproducerb), N(producvotera), N(producvoterb), N(producvoterc), N(producvoterd) } ) {
+      create_account_with_resources( a, config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   }
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(defproducera) ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(defproducerb) ) );
+
+   // producvotera votes directly, producvoterc through the proxy producvoterb, producvoterd for a producer
+   // with a legacy `voterbonus` balance
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("200000000.0000"), config::system_account_name );
+   transfer( config::system_account_name, "producvoterb", core_sym::from_string("100000000.0000"), config::system_account_name );
+   transfer( config::system_account_name, "producvoterc", core_sym::from_string("100000000.0000"), config::system_account_name );
+   transfer( config::system_account_name, "producvoterd", core_sym::from_string("200000000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvoterb", core_sym::from_string("50000000.0000"), core_sym::from_string("50000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvoterc", core_sym::from_string("50000000.0000"), core_sym::from_string("50000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvoterd", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(producvoterb), N(regproxy), mvo()("proxy", "producvoterb")("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvotera), { N(defproducera) } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvoterb), { N(defproducera) } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvoterc), vector<account_name>(), N(producvoterb) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvoterd), { N(defproducerb) } ) );
+
+   const asset legacy = core_sym::from_string("1000.0000");
+   {
+      vector<char> row = fc::raw::pack( N(defproducerb) );
+      const vector<char> balance = fc::raw::pack( legacy );
+      row.insert( row.end(), balance.begin(), balance.end() );
+      set_system_row( N(voterbonus), row, bonus_wasm );
+   }
+
+   produce_blocks( 50 );
+   produce_block( fc::hours(24) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducera), N(claimrewards), mvo()("owner", "defproducera") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducerb), N(claimrewards), mvo()("owner", "defproducerb") ) );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(voterbonus), N(defproducerb) ).empty() );
+
+   // the `voterbonus` balance each producer would have held under the old scheme
+   const double votes_a   = get_producer_info( N(defproducera) )["total_votes"].as_double();
+   const double votes_b   = get_producer_info( N(defproducerb) )["total_votes"].as_double();
+   const double balance_a = std::llround( get_producer_bonus( N(defproducera) )["bonus_per_vote"].as_double() * votes_a );
+   const double balance_b = std::llround( get_producer_bonus( N(defproducerb) )["bonus_per_vote"].as_double() * votes_b );
+   BOOST_TEST_REQUIRE( 0 < balance_a );
+   BOOST_TEST_REQUIRE( legacy.get_amount() < balance_b );
+
+   // the old per-producer formula: the producer's balance times the voter's own weight over the producer's votes
+   auto old_bonus = []( double balance, double weight, double votes ) { return static_cast<int64_t>( balance * weight / votes ); };
+   auto claim = [&]( const account_name& owner ) -> int64_t {
+      const asset before = get_balance( owner );
+      BOOST_REQUIRE_EQUAL( success(), push_action( owner, N(claimbonus), mvo()("owner", owner) ) );
+      return ( get_balance( owner ) - before ).get_amount();
+   };
+   auto within_one = []( int64_t a, int64_t b ) { return std::abs( a - b ) <= 1; };
+
+   const auto voter_a = get_voter_info( N(producvotera) );
+   const auto voter_b = get_voter_info( N(producvoterb) );
+   const auto voter_c = get_voter_info( N(producvoterc) );
+   const auto voter_d = get_voter_info( N(producvoterd) );
+   BOOST_TEST_REQUIRE( within_one( old_bonus( balance_a, voter_a["last_vote_weight"].as_double(), votes_a ), claim( N(producvotera) ) ) );
+   BOOST_TEST_REQUIRE( within_one( old_bonus( balance_a, voter_b["last_vote_weight"].as_double() - voter_b["proxied_vote_weight"].as_double(), votes_a ),
+                                   claim( N(producvoterb) ) ) );
+   BOOST_TEST_REQUIRE( within_one( old_bonus( balance_a, voter_c["last_vote_weight"].as_double(), votes_a ), claim( N(producvoterc) ) ) );
+   BOOST_TEST_REQUIRE( within_one( old_bonus( balance_b, voter_d["last_vote_weight"].as_double(), votes_b ), claim( N(producvoterd) ) ) );
+
+   // everything owed was paid
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no voter bonus to claim"),
+                        push_action( N(producvotera), N(claimbonus), mvo()("owner", "producvotera") ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( compact_vote_encoding_round_trip, eosio_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   cross_15_percent_threshold();
+
+   create_accounts_with_resources( {  N(defproducer1), N(defproducer2), N(defproducer3) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer3", 3) );
+
+   issue( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0002"), core_sym::from_string("50.0001") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1), N(defproducer2), N(defproducer3) } ) );
+   BOOST_REQUIRE_EQUAL( 3, get_voter_info( "bob111111111" )["producers"].get_array().size() );
+
+   //names are turned into ids by the next write of the voter row
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setvoteenc), mvo()("compact", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("30.0001"), core_sym::from_string("20.0001") ) );
+   auto voter = get_voter_info( "bob111111111" );
+   BOOST_REQUIRE_EQUAL( 0, voter["producers"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( 3, voter["producer_ids"].get_array().size() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer3" )["total_votes"].as_double() );
+
+   //the ids decode back to the same producers, and to names once compact encoding is off
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setvoteenc), mvo()("compact", false) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1), N(defproducer3) } ) );
+   voter = get_voter_info( "bob111111111" );
+   BOOST_REQUIRE_EQUAL( 2, voter["producers"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( "defproducer1", voter["producers"][size_t(0)].as_string() );
+   BOOST_REQUIRE_EQUAL( "defproducer3", voter["producers"][size_t(1)].as_string() );
+   BOOST_REQUIRE( !voter.get_object().contains( "producer_ids" ) || voter["producer_ids"].get_array().empty() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( 0 == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer3" )["total_votes"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::tolerance(1e-10)) try {
 
    const double continuous_rate = 4.879 / 100.;
@@ -1225,7 +1612,7 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
       const int64_t  initial_savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
 
       prod = get_producer_info("defproducera");
       const uint32_t unpaid_blocks = prod["unpaid_blocks"].as<uint32_t>();
@@ -1243,7 +1630,7 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
       const int64_t  savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
 
       prod = get_producer_info("defproducera");
       BOOST_REQUIRE_EQUAL(1, prod["unpaid_blocks"].as<uint32_t>());
@@ -1301,7 +1688,7 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
       const int64_t  initial_savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
       const double   initial_tot_vote_weight   = initial_global_state["total_producer_vote_weight"].as<double>();
 
       prod = get_producer_info("defproducera");
@@ -1324,7 +1711,7 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
       const int64_t  savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
 
       prod = get_producer_info("defproducera");
       BOOST_REQUIRE_EQUAL(1, prod["unpaid_blocks"].as<uint32_t>());
@@ -1384,6 +1771,27 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( global_row_lags_block_stats, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   produce_block( fc::minutes(2) );
+   produce_blocks( 50 );
+
+   // onblock only writes `blockstats`, so the per-block fields of the raw `global` row fall behind
+   auto unpaid_lag = [&]() {
+      return int64_t( get_block_stats()["total_unpaid_blocks"].as<uint32_t>() ) - int64_t( get_global_state()["total_unpaid_blocks"].as<uint32_t>() );
+   };
+   BOOST_TEST_REQUIRE( 1 < unpaid_lag() );
+
+   // until an action writes `global` anyway; only the onblock of the block after it has run since
+   issue( "alice1111111", core_sym::from_string("1000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(producer1111) } ) );
+   BOOST_TEST_REQUIRE( 0 <= unpaid_lag() );
+   BOOST_TEST_REQUIRE( unpaid_lag() <= 1 );
+   BOOST_REQUIRE_EQUAL( get_block_stats()["last_name_close"].as_string(), get_global_state()["last_name_close"].as_string() );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::unit_test::tolerance(1e-10)) try {
 
    auto within_one = [](int64_t a, int64_t b) -> bool { return std::abs( a - b ) <= 1; };
@@ -1501,7 +1909,7 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
       const int64_t  initial_savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
       const asset    initial_supply            = get_token_supply();
       const asset    initial_bpay_balance      = get_balance(N(eosio.bpay));
       const asset    initial_vpay_balance      = get_balance(N(eosio.vpay));
@@ -1515,7 +1923,7 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
       const int64_t  savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
       const asset    supply            = get_token_supply();
       const asset    bpay_balance      = get_balance(N(eosio.bpay));
       const asset    vpay_balance      = get_balance(N(eosio.vpay));
@@ -1577,7 +1985,7 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
       const int64_t  initial_savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
       const asset    initial_supply            = get_token_supply();
       const asset    initial_bpay_balance      = get_balance(N(eosio.bpay));
       const asset    initial_vpay_balance      = get_balance(N(eosio.vpay));
@@ -1591,7 +1999,7 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
       const int64_t  savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
       const asset    supply            = get_token_supply();
       const asset    bpay_balance      = get_balance(N(eosio.bpay));
       const asset    vpay_balance      = get_balance(N(eosio.vpay));
@@ -1711,7 +2119,7 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const uint64_t initial_bucket_fill_time  = microseconds_since_epoch_of_iso_string( initial_global_state["last_pervote_bucket_fill"] );
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
       const asset    initial_supply            = get_token_supply();
       const asset    initial_balance           = get_balance(prod_name);
       const uint32_t initial_unpaid_blocks     = initial_prod_info["unpaid_blocks"].as<uint32_t>();
@@ -1728,7 +2136,7 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const uint64_t bucket_fill_time  = microseconds_since_epoch_of_iso_string( global_state["last_pervote_bucket_fill"] );
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_block_stats()["total_unpaid_blocks"].as<uint32_t>();
       const asset    supply            = get_token_supply();
       const asset    balance           = get_balance(prod_name);
       const uint32_t unpaid_blocks     = prod_info["unpaid_blocks"].as<uint32_t>();
@@ -1765,6 +2173,56 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE(claimall_pays_producers, eosio_system_tester) try {
+   const auto producer_names = active_and_vote_producers();
+   produce_block(fc::hours(24));
+   produce_blocks(21 * 12);
+
+   const auto     initial_global_state = get_global_state();
+   const asset    initial_supply       = get_token_supply();
+   const asset    initial_system       = get_balance(config::system_account_name);
+   const asset    initial_savings      = get_balance(N(eosio.saving));
+   const asset    initial_bpay         = get_balance(N(eosio.bpay));
+   const asset    initial_vpay         = get_balance(N(eosio.vpay));
+   std::vector<asset> initial_balances;
+   for (const auto& p: producer_names) {
+      initial_balances.push_back(get_balance(p));
+   }
+
+   // anyone can crank, and producers that already claimed are skipped without using up max
+   BOOST_REQUIRE_EQUAL(wasm_assert_msg("max must be positive"),
+                       push_action(N(alice1111111), N(claimall), mvo()("caller", "alice1111111")("max", 0)));
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(alice1111111), N(claimall), mvo()("caller", "alice1111111")("max", 1)));
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(bob111111111), N(claimall), mvo()("caller", "bob111111111")("max", producer_names.size() - 1)));
+
+   // every producer is claimed, and the inflation is accounted for exactly once
+   asset paid = core_sym::from_string("0.0000");
+   for (size_t i = 0; i < producer_names.size(); ++i) {
+      BOOST_REQUIRE_EQUAL(0, get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>());
+      BOOST_REQUIRE(initial_balances[i] <= get_balance(producer_names[i]));
+      paid += get_balance(producer_names[i]) - initial_balances[i];
+   }
+   BOOST_REQUIRE(paid.get_amount() > 0);
+   BOOST_REQUIRE_EQUAL(initial_system, get_balance(config::system_account_name));
+   BOOST_REQUIRE_EQUAL(get_token_supply() - initial_supply,
+                       (get_balance(N(eosio.saving)) - initial_savings) + (get_balance(N(eosio.bpay)) - initial_bpay)
+                       + (get_balance(N(eosio.vpay)) - initial_vpay) + paid);
+
+   const auto global_state = get_global_state();
+   BOOST_REQUIRE_EQUAL(0, get_block_stats()["total_unpaid_blocks"].as<uint32_t>());
+   BOOST_REQUIRE_EQUAL(get_balance(N(eosio.bpay)).get_amount(), global_state["perblock_bucket"].as<int64_t>());
+   BOOST_REQUIRE_EQUAL(get_balance(N(eosio.vpay)).get_amount(), global_state["pervote_bucket"].as<int64_t>());
+
+   BOOST_REQUIRE_EQUAL(wasm_assert_msg("already claimed rewards within past day"),
+                       push_action(N(defproducera), N(claimrewards), mvo()("owner", "defproducera")));
+
+   // a repeated pass pays nobody twice
+   produce_blocks(2);
+   const asset balance_a = get_balance(N(defproducera));
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(carol1111111), N(claimall), mvo()("caller", "carol1111111")("max", 21)));
+   BOOST_REQUIRE_EQUAL(balance_a, get_balance(N(defproducera)));
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE(multiple_producer_votepay_share, eosio_system_tester, * boost::unit_test::tolerance(1e-10)) try {
 
    const asset net = core_sym::from_string("80.0000");
@@ -2508,7 +2966,7 @@ BOOST_FIXTURE_TEST_CASE(producer_onblock_check, eosio_system_tester) try {
 
    {
       const char* claimrewards_activation_error_message = "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)";
-      BOOST_CHECK_EQUAL(0, get_global_state()["total_unpaid_blocks"].as<uint32_t>());
+      BOOST_CHECK_EQUAL(0, get_block_stats()["total_unpaid_blocks"].as<uint32_t>());
       BOOST_REQUIRE_EQUAL(wasm_assert_msg( claimrewards_activation_error_message ),
                           push_action(producer_names.front(), N(claimrewards), mvo()("owner", producer_names.front())));
       BOOST_REQUIRE_EQUAL(0, get_balance(producer_names.front()).get_amount());
@@ -3489,6 +3947,94 @@ BOOST_FIXTURE_TEST_CASE( buy_sell_rex, eosio_system_tester ) try {
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( quote_rex_and_ram, eosio_system_tester ) try {
+
+   const asset init_balance = core_sym::from_string("60000.0000");
+   const std::vector<account_name> accounts = { N(aliceaccount), N(bobbyaccount), N(carolaccount), N(emilyaccount) };
+   account_name alice = accounts[0], bob = accounts[1], carol = accounts[2], emily = accounts[3];
+   setup_rex_accounts( accounts, init_balance );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("rex system not initialized yet"),
+                        push_action( bob, N(quoterexbuy), mvo()("amount", core_sym::from_string("1.0000")) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("rex loans are currently not available"),
+                        push_action( bob, N(quoterent), mvo()("payment", core_sym::from_string("1.0000")) ) );
+   BOOST_REQUIRE_EQUAL( success(), buyrex( alice, core_sym::from_string("50265.0000") ) );
+
+   // quotes need no authorization and leave the pool untouched
+   {
+      const std::string init_pool = fc::json::to_string( get_rex_pool() );
+      BOOST_REQUIRE_EQUAL( success(), push_action( bob, N(quoterexbuy), mvo()("amount", core_sym::from_string("1.0000")), false ) );
+      BOOST_REQUIRE_EQUAL( success(), push_action( bob, N(quoterent), mvo()("payment", core_sym::from_string("1.0000")), false ) );
+      BOOST_REQUIRE_EQUAL( init_pool, fc::json::to_string( get_rex_pool() ) );
+      BOOST_REQUIRE_EQUAL( wasm_assert_msg("asset must be core token"),
+                           push_action( bob, N(quoterexbuy), mvo()("amount", asset::from_string("1.0000 REX")) ) );
+      BOOST_REQUIRE_EQUAL( wasm_assert_msg("must use positive asset amount"),
+                           push_action( bob, N(quoterent), mvo()("payment", core_sym::from_string("0.0000")) ) );
+   }
+
+   // each quote runs ahead of the action it quotes, in the same transaction
+   {
+      const asset amount = core_sym::from_string("123.4567");
+      auto quote = get_quote_result( push_quoted( bob, N(quoterexbuy), mvo()("amount", amount),
+                                                  N(buyrex), mvo()("from", bob)("amount", amount) ) );
+      BOOST_REQUIRE_EQUAL( amount,               quote.first );
+      BOOST_REQUIRE_EQUAL( get_rex_balance(bob), quote.second );
+   }
+   {
+      const asset payment = core_sym::from_string("17.0000");
+      auto quote = get_quote_result( push_quoted( carol, N(quoterent), mvo()("payment", payment),
+                                                  N(rentcpu), mvo()("from", carol)("receiver", carol)
+                                                                   ("loan_payment", payment)("loan_fund", core_sym::from_string("0.0000")) ) );
+      BOOST_REQUIRE_EQUAL( payment,                                       quote.first );
+      BOOST_REQUIRE_EQUAL( get_cpu_loan(1)["total_staked"].as<asset>(), quote.second );
+   }
+   produce_block( fc::days(5) );
+   {
+      const asset rex        = asset::from_string("1000.0000 REX");
+      const asset init_fund  = get_rex_fund( alice );
+      auto quote = get_quote_result( push_quoted( alice, N(quoterexsell), mvo()("rex", rex),
+                                                  N(sellrex), mvo()("from", alice)("rex", rex) ) );
+      BOOST_REQUIRE_EQUAL( rex,                                quote.first );
+      BOOST_REQUIRE_EQUAL( get_rex_fund( alice ) - init_fund, quote.second );
+   }
+
+   // RAM quotes include the supply increase update_ram_supply would apply in the same block
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setramrate), mvo()("bytes_per_block", 1000) ) );
+   transfer( config::system_account_name, emily, core_sym::from_string("100.0000"), config::system_account_name );
+   produce_blocks( 10 );
+   {
+      const asset   quant      = core_sym::from_string("10.0000");
+      const int64_t init_bytes = get_total_stake( emily )["ram_bytes"].as_int64();
+      auto quote = get_quote_result( push_quoted( emily, N(quoteram), mvo()("quant", quant),
+                                                  N(buyram), mvo()("payer", emily)("receiver", emily)("quant", quant) ) );
+      BOOST_REQUIRE_EQUAL( quant,                                                             quote.first );
+      BOOST_REQUIRE_EQUAL( get_total_stake( emily )["ram_bytes"].as_int64() - init_bytes, quote.second.get_amount() );
+   }
+   produce_blocks( 10 );
+   {
+      const asset   init_tokens = get_balance( emily );
+      const int64_t init_bytes  = get_total_stake( emily )["ram_bytes"].as_int64();
+      auto quote = get_quote_result( push_quoted( emily, N(quoteram), mvo()("quant", asset::from_string("4096 RAM")),
+                                                  N(buyrambytes), mvo()("payer", emily)("receiver", emily)("bytes", 4096) ) );
+      BOOST_REQUIRE_EQUAL( init_tokens - get_balance( emily ),                              quote.first );
+      BOOST_REQUIRE_EQUAL( get_total_stake( emily )["ram_bytes"].as_int64() - init_bytes, quote.second.get_amount() );
+   }
+   produce_blocks( 10 );
+   {
+      const asset init_tokens = get_balance( emily );
+      auto quote = get_quote_result( push_quoted( emily, N(quoteramsell), mvo()("bytes", 2048),
+                                                  N(sellram), mvo()("account", emily)("bytes", 2048) ) );
+      BOOST_REQUIRE_EQUAL( asset::from_string("2048 RAM"),   quote.first );
+      BOOST_REQUIRE_EQUAL( get_balance( emily ) - init_tokens, quote.second );
+   }
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must buy ram with core token"),
+                        push_action( emily, N(quoteram), mvo()("quant", asset::from_string("1.0000 REX")) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("cannot sell negative byte"),
+                        push_action( emily, N(quoteramsell), mvo()("bytes", 0) ) );
+
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE( buy_sell_small_rex, eosio_system_tester ) try {
 
    const int64_t ratio        = 10000;
@@ -4294,6 +4840,103 @@ BOOST_FIXTURE_TEST_CASE( rex_maturity, eosio_system_tester ) try {
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( rex_maturity_buckets, eosio_system_tester ) try {
+
+   const asset init_balance = core_sym::from_string("1000000.0000");
+   const std::vector<account_name> accounts = { N(aliceaccount), N(bobbyaccount) };
+   account_name alice = accounts[0], bob = accounts[1];
+   setup_rex_accounts( accounts, init_balance );
+
+   const int64_t rex_ratio = 10000;
+   auto buckets_total = []( const fc::variant& rex_balance ) {
+      int64_t total = 0;
+      for ( const auto& b : rex_balance["maturity_buckets"]["buckets"].get_array() ) {
+         total += b.as<int64_t>();
+      }
+      return total;
+   };
+   auto set_fixed_maturities = [&]( bool fixed ) {
+      return push_action( config::system_account_name, N(setrexenc), mvo()("fixed_maturities", fixed) );
+   };
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( alice, N(setrexenc), mvo()("fixed_maturities", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), set_fixed_maturities( true ) );
+
+   // a row is only migrated when its buckets take no more space than rex_maturities
+   BOOST_REQUIRE_EQUAL( success(), buyrex( alice, core_sym::from_string("11.5000") ) );
+   BOOST_REQUIRE_EQUAL( success(), updaterex( alice ) );
+   auto rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE( !rex_balance.get_object().contains( "maturity_buckets" ) );
+   BOOST_REQUIRE_EQUAL( 1,                  rex_balance["rex_maturities"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( success(),          mvtosavings( alice, asset::from_string("15000.0000 REX") ) );
+   BOOST_REQUIRE_EQUAL( 2,                  get_rex_balance_obj( alice )["rex_maturities"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( success(),          updaterex( alice ) );
+   rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE_EQUAL( 0,                  rex_balance["rex_maturities"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( 1,                  rex_balance["maturity_buckets"]["buckets"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( 100000 * rex_ratio, buckets_total( rex_balance ) );
+   BOOST_REQUIRE_EQUAL( 15000 * rex_ratio,  rex_balance["maturity_buckets"]["savings"].as<int64_t>() );
+
+   // migrated rows mature exactly like in rex_maturity
+   produce_block( fc::hours(3) );
+   BOOST_REQUIRE_EQUAL( success(), buyrex( alice, core_sym::from_string("18.5000") ) );
+   produce_block( fc::hours(25) );
+   BOOST_REQUIRE_EQUAL( success(), buyrex( alice, core_sym::from_string("25.0000") ) );
+
+   rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE_EQUAL( 550000 * rex_ratio, rex_balance["rex_balance"].as<asset>().get_amount() );
+   BOOST_REQUIRE_EQUAL( 0,                  rex_balance["matured_rex"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 0,                  rex_balance["rex_maturities"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( 535000 * rex_ratio, buckets_total( rex_balance ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
+                        sellrex( alice, asset::from_string("100000.0000 REX") ) );
+   produce_block( fc::hours( 3*24 + 20) );
+   BOOST_REQUIRE_EQUAL( success(),          sellrex( alice, asset::from_string("285000.0000 REX") ) );
+   rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE_EQUAL( 265000 * rex_ratio, rex_balance["rex_balance"].as<asset>().get_amount() );
+   BOOST_REQUIRE_EQUAL( 0,                  rex_balance["matured_rex"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 250000 * rex_ratio, buckets_total( rex_balance ) );
+   produce_block( fc::hours(23) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
+                        sellrex( alice, asset::from_string("250000.0000 REX") ) );
+   produce_block( fc::days(1) );
+   BOOST_REQUIRE_EQUAL( success(),          sellrex( alice, asset::from_string("130000.0000 REX") ) );
+   rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE_EQUAL( 135000 * rex_ratio, rex_balance["rex_balance"].as<asset>().get_amount() );
+   BOOST_REQUIRE_EQUAL( 120000 * rex_ratio, rex_balance["matured_rex"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 0,                  rex_balance["maturity_buckets"]["buckets"].get_array().size() );
+
+   // savings and consolidation work on the compact buckets
+   BOOST_REQUIRE_EQUAL( success(),          mvtosavings( alice, asset::from_string("20000.0000 REX") ) );
+   rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE_EQUAL( 100000 * rex_ratio, rex_balance["matured_rex"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 35000 * rex_ratio,  rex_balance["maturity_buckets"]["savings"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( success(),          consolidate( alice ) );
+   rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE_EQUAL( 0,                  rex_balance["matured_rex"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 1,                  rex_balance["maturity_buckets"]["buckets"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( 100000 * rex_ratio, buckets_total( rex_balance ) );
+   BOOST_REQUIRE_EQUAL( 35000 * rex_ratio,  rex_balance["maturity_buckets"]["savings"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( success(),          mvfrsavings( alice, asset::from_string("35000.0000 REX") ) );
+   rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE_EQUAL( 135000 * rex_ratio, buckets_total( rex_balance ) );
+   BOOST_REQUIRE_EQUAL( 0,                  rex_balance["maturity_buckets"]["savings"].as<int64_t>() );
+
+   // a single bucket is smaller in rex_maturities, and migrated rows keep the new encoding
+   BOOST_REQUIRE_EQUAL( success(), buyrex( bob, core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), updaterex( bob ) );
+   BOOST_REQUIRE( !get_rex_balance_obj( bob ).get_object().contains( "maturity_buckets" ) );
+   BOOST_REQUIRE_EQUAL( success(), set_fixed_maturities( false ) );
+   BOOST_REQUIRE_EQUAL( success(), buyrex( alice, core_sym::from_string("1.0000") ) );
+   rex_balance = get_rex_balance_obj( alice );
+   BOOST_REQUIRE_EQUAL( 0,                  rex_balance["rex_maturities"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( 145000 * rex_ratio, buckets_total( rex_balance ) );
+
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
 
    const asset init_balance = core_sym::from_string("100000.0000");
@@ -4839,6 +5482,148 @@ BOOST_FIXTURE_TEST_CASE( set_rex, eosio_system_tester ) try {
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( rex_maintenance_crank, eosio_system_tester ) try {
+
+   const asset init_balance = core_sym::from_string("25000.0000");
+   const std::vector<account_name> accounts = { N(aliceaccount), N(bobbyaccount), N(carolaccount) };
+   account_name alice = accounts[0], bob = accounts[1], carol = accounts[2];
+   setup_rex_accounts( accounts, init_balance );
+
+   const name act_name{ N(setrexmaint) };
+   const asset reward = core_sym::from_string("0.0010");
+   auto maint_config = [&]( uint32_t user_backlog, uint16_t crank_batch, const asset& reward_per_item ) {
+      return mvo()("user_backlog", user_backlog)("user_batch", 2)("crank_batch", crank_batch)("reward_per_item", reward_per_item)
+                   ("partial_fills", false);
+   };
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( alice, act_name, maint_config( 5, 1, reward ) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("crank_batch must be positive"),
+                        push_action( config::system_account_name, act_name, maint_config( 5, 0, reward ) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("reward must use core token"),
+                        push_action( config::system_account_name, act_name, maint_config( 5, 1, asset::from_string("0.0010 RND") ) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("reward must be non-negative"),
+                        push_action( config::system_account_name, act_name, maint_config( 5, 1, core_sym::from_string("-0.0010") ) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, act_name, maint_config( 5, 1, reward ) ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("rex system not initialized yet"),
+                        push_action( carol, N(rexmaint), mvo()("caller", carol)("max", 10) ) );
+
+   BOOST_REQUIRE_EQUAL( success(), buyrex( alice, core_sym::from_string("20000.0000") ) );
+   for ( int i = 0; i < 3; ++i ) {
+      BOOST_REQUIRE_EQUAL( success(), rentcpu( bob, bob, core_sym::from_string("10.0000") ) );
+   }
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("max must be positive"),
+                        push_action( carol, N(rexmaint), mvo()("caller", carol)("max", 0) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no REX maintenance due"),
+                        push_action( carol, N(rexmaint), mvo()("caller", carol)("max", 10) ) );
+
+   produce_block( fc::days(30) );
+   produce_blocks( 2 );
+
+   // three expired loans do not exceed the backlog threshold, user actions leave them alone
+   BOOST_REQUIRE_EQUAL( success(), updaterex( alice ) );
+   for ( uint64_t loan_num = 1; loan_num <= 3; ++loan_num ) {
+      BOOST_REQUIRE( !get_cpu_loan( loan_num ).is_null() );
+   }
+
+   // the crank closes at most crank_batch loans and rewards the caller for each
+   const asset init_carol_fund = get_rex_fund( carol );
+   const asset init_lendable   = get_rex_pool()["total_lendable"].as<asset>();
+   BOOST_REQUIRE_EQUAL( success(), push_action( carol, N(rexmaint), mvo()("caller", carol)("max", 10) ) );
+   BOOST_REQUIRE( get_cpu_loan( 1 ).is_null() );
+   BOOST_REQUIRE( !get_cpu_loan( 2 ).is_null() );
+   BOOST_REQUIRE_EQUAL( init_carol_fund + reward, get_rex_fund( carol ) );
+   BOOST_REQUIRE_EQUAL( init_lendable - reward,   get_rex_pool()["total_lendable"].as<asset>() );
+
+   // once the backlog exceeds the threshold, user actions process it again
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, act_name, maint_config( 1, 1, reward ) ) );
+   BOOST_REQUIRE_EQUAL( success(), updaterex( alice ) );
+   BOOST_REQUIRE( get_cpu_loan( 2 ).is_null() );
+   BOOST_REQUIRE( get_cpu_loan( 3 ).is_null() );
+   BOOST_REQUIRE_EQUAL( init_carol_fund + reward, get_rex_fund( carol ) );
+
+   // an item earns at most a tenth of its loan payment
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, act_name, maint_config( 5, 1, core_sym::from_string("5.0000") ) ) );
+   BOOST_REQUIRE_EQUAL( success(), rentcpu( bob, bob, core_sym::from_string("10.0000") ) );
+   produce_block( fc::days(30) );
+   produce_blocks( 2 );
+   const asset carol_fund = get_rex_fund( carol );
+   BOOST_REQUIRE_EQUAL( success(), push_action( carol, N(rexmaint), mvo()("caller", carol)("max", 10) ) );
+   BOOST_REQUIRE( get_cpu_loan( 4 ).is_null() );
+   BOOST_REQUIRE_EQUAL( carol_fund + core_sym::from_string("1.0000"), get_rex_fund( carol ) );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_FIXTURE_TEST_CASE( rex_partial_fills, eosio_system_tester ) try {
+
+   const asset init_balance = core_sym::from_string("100000.0000");
+   const std::vector<account_name> accounts = { N(aliceaccount), N(bobbyaccount), N(emilyaccount) };
+   account_name alice = accounts[0], bob = accounts[1], emily = accounts[2];
+   setup_rex_accounts( accounts, init_balance );
+
+   BOOST_REQUIRE_EQUAL( success(), buyrex( alice, core_sym::from_string("10000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), buyrex( bob,   core_sym::from_string("10000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setrex), mvo()("balance", core_sym::from_string("100.0000")) ) );
+   // a cheap loan leaves the pool unable to pay out all of bob's REX at once
+   BOOST_REQUIRE_EQUAL( success(), rentcpu( emily, emily, core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setrexmaint), mvo()
+                                                ("user_backlog", 0)("user_batch", 2)("crank_batch", 50)
+                                                ("reward_per_item", core_sym::from_string("0.0000"))("partial_fills", true) ) );
+
+   produce_block( fc::days(5) );
+
+   const asset init_bob_rex  = get_rex_balance( bob );
+   const asset init_bob_fund = get_rex_fund( bob );
+   BOOST_REQUIRE_EQUAL( success(), sellrex( bob, init_bob_rex ) );
+   BOOST_REQUIRE_EQUAL( true,          get_rex_order( bob )["is_open"].as<bool>() );
+   BOOST_REQUIRE_EQUAL( init_bob_rex,  get_rex_order( bob )["rex_requested"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( 0,             get_rex_order( bob )["proceeds"].as<asset>().get_amount() );
+
+   // the next maintenance pass sells what the pool can pay out and keeps the order open for the rest
+   BOOST_REQUIRE_EQUAL( success(), updaterex( alice ) );
+   const auto    order    = get_rex_order( bob );
+   const asset   proceeds = order["proceeds"].as<asset>();
+   const int64_t filled   = init_bob_rex.get_amount() - order["rex_requested"].as<asset>().get_amount();
+   BOOST_REQUIRE_EQUAL( true, order["is_open"].as<bool>() );
+   BOOST_TEST_REQUIRE( 0 < proceeds.get_amount() );
+   BOOST_TEST_REQUIRE( 0 < filled );
+   BOOST_TEST_REQUIRE( filled < init_bob_rex.get_amount() );
+   BOOST_REQUIRE_EQUAL( init_bob_rex.get_amount() - filled, get_rex_balance( bob ).get_amount() );
+   {
+      const auto pool = get_rex_pool();
+      const int64_t available = pool["total_unlent"].as<asset>().get_amount() - 2 * pool["total_lent"].as<asset>().get_amount() / 10;
+      BOOST_TEST_REQUIRE( available < proceeds.get_amount() / 100 );
+   }
+
+   // owner actions deliver the partial proceeds, the remainder stays queued
+   const asset remaining = order["rex_requested"].as<asset>();
+   BOOST_REQUIRE_EQUAL( success(), updaterex( bob ) );
+   BOOST_REQUIRE_EQUAL( init_bob_fund + proceeds, get_rex_fund( bob ) );
+   BOOST_REQUIRE_EQUAL( true,      get_rex_order( bob )["is_open"].as<bool>() );
+   BOOST_REQUIRE_EQUAL( 0,         get_rex_order( bob )["proceeds"].as<asset>().get_amount() );
+   BOOST_REQUIRE_EQUAL( remaining, get_rex_order( bob )["rex_requested"].as<asset>() );
+
+   // further passes do not sell the dust left in the pool, and the crank finds nothing to do
+   for ( int i = 0; i < 3; ++i ) {
+      produce_blocks( 1 );
+      BOOST_REQUIRE_EQUAL( success(), updaterex( alice ) );
+      BOOST_REQUIRE_EQUAL( remaining, get_rex_order( bob )["rex_requested"].as<asset>() );
+      BOOST_REQUIRE_EQUAL( 0,         get_rex_order( bob )["proceeds"].as<asset>().get_amount() );
+   }
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no REX maintenance due"),
+                        push_action( alice, N(rexmaint), mvo()("caller", alice)("max", 10) ) );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( bob, N(cnclrexorder), mvo()("owner", bob) ) );
+   BOOST_REQUIRE_EQUAL( true,                     get_rex_order_obj( bob ).is_null() );
+   BOOST_REQUIRE_EQUAL( init_bob_fund + proceeds, get_rex_fund( bob ) );
+
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE( b1_vesting, eosio_system_tester ) try {
 
    cross_15_percent_threshold();
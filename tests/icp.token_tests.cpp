@@ -0,0 +1,188 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/testing/tester.hpp>
+#include <eosio/chain/abi_serializer.hpp>
+
+#include <Runtime/Runtime.h>
+
+#include <fc/variant_object.hpp>
+#include "contracts.hpp"
+
+using namespace eosio::testing;
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+using namespace fc;
+using namespace std;
+
+using mvo = fc::mutable_variant_object;
+
+/// the icp contract's `packets` row, as read by icp.token
+struct icp_packet_row {
+   uint64_t seq;
+   uint32_t expiration;
+   bytes    send_action;
+   bytes    receipt_action;
+   uint8_t  status;
+   uint8_t  shadow;
+};
+FC_REFLECT( icp_packet_row, (seq)(expiration)(send_action)(receipt_action)(status)(shadow) )
+
+static constexpr uint8_t receipt_expired = 2;
+
+class icp_token_tester : public tester {
+public:
+
+   icp_token_tester() {
+      produce_blocks( 2 );
+
+      create_accounts( { N(alice), N(bob), N(icp), N(icp.token) } );
+      produce_blocks( 2 );
+
+      set_code( N(icp.token), contracts::icp_token_wasm() );
+      set_abi( N(icp.token), contracts::icp_token_abi().data() );
+      // the icp contract is stood in for by one whose packets are set by hand
+      set_code( N(icp), contracts::util::icp_packets_wast().c_str() );
+
+      // icp.token sends its packets with icp@sendaction, and receives them with its own callback permission
+      set_authority( N(icp), N(sendaction), authority( 1, {}, { permission_level_weight{ { N(icp.token), config::eosio_code_name }, 1 } } ), config::active_name );
+      link_authority( N(icp), N(icp), N(sendaction), N(sendaction) );
+      set_authority( N(icp.token), N(callback), authority( get_public_key( N(icp.token), "callback" ) ), config::active_name );
+      link_authority( N(icp.token), N(icp.token), N(callback), N(icpreceive) );
+
+      produce_blocks();
+
+      const auto& accnt = control->db().get<account_object,by_name>( N(icp.token) );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      abi_ser.set_abi(abi, abi_serializer_max_time);
+
+      BOOST_REQUIRE_EQUAL( success(), push_action( N(icp.token), N(setcontracts), mvo()("icp", "icp")("peer", "peer") ) );
+      BOOST_REQUIRE_EQUAL( success(), push_action( N(icp.token), N(create), mvo()("contract", "eosio.token")("symbol", "4,TKN") ) );
+   }
+
+   action_result push_action( const permission_level& auth, const action_name& name, const variant_object& data ) {
+      signed_transaction trx;
+      trx.actions.emplace_back( vector<permission_level>{ auth }, N(icp.token), name,
+                                abi_ser.variant_to_binary( abi_ser.get_action_type(name), data, abi_serializer_max_time ) );
+      set_transaction_headers( trx );
+      trx.sign( get_private_key( auth.actor, auth.permission.to_string() ), control->get_chain_id() );
+      try {
+         push_transaction( trx );
+      } catch ( const fc::exception& ex ) {
+         return error( ex.top_message() );
+      }
+      produce_block();
+      return success();
+   }
+
+   action_result push_action( const account_name& signer, const action_name& name, const variant_object& data ) {
+      return push_action( permission_level{ signer, config::active_name }, name, data );
+   }
+
+   action_result icpreceive( account_name to, const asset& quantity ) {
+      return push_action( permission_level{ N(icp.token), N(callback) }, N(icpreceive), mvo()
+                          ("contract", "eosio.token")("icp_from", "peeraccount")("to", to)
+                          ("quantity", quantity)("memo", "")("refund", 0) );
+   }
+
+   action_result icprefund( account_name from, const asset& quantity, uint32_t expiration ) {
+      return push_action( from, N(icprefund), mvo()
+                          ("contract", "eosio.token")("from", from)("icp_to", "peeraccount")
+                          ("quantity", quantity)("memo", "")("expiration", expiration) );
+   }
+
+   action_result sweeplocked( account_name caller, uint32_t max ) {
+      return push_action( caller, N(sweeplocked), mvo()("max", max) );
+   }
+
+   void set_packet( uint64_t seq, uint8_t status ) {
+      action act;
+      act.account = N(icp);
+      act.name    = N(setpacket);
+      act.data    = fc::raw::pack( icp_packet_row{ seq, 0, {}, {}, status, 0 } );
+      BOOST_REQUIRE_EQUAL( success(), base_tester::push_action( std::move(act), uint64_t(N(icp)) ) );
+   }
+
+   uint32_t now() const {
+      return control->head_block_time().sec_since_epoch();
+   }
+
+   asset get_balance( account_name owner ) {
+      vector<char> data = get_row_by_account( N(icp.token), owner, N(balances), 0 );
+      return data.empty() ? asset() : abi_ser.binary_to_variant( "owner_balance", data, abi_serializer_max_time )["balance"].as<asset>();
+   }
+
+   vector<fc::variant> get_locks() {
+      vector<fc::variant> locks;
+      const auto& db = control->db();
+      const auto* t_id = db.find<table_id_object, by_code_scope_table>( boost::make_tuple( N(icp.token), N(icp.token), N(locks) ) );
+      if ( !t_id ) {
+         return locks;
+      }
+      const auto& idx = db.get_index<key_value_index, by_scope_primary>();
+      for ( auto itr = idx.lower_bound( boost::make_tuple( t_id->id, 0 ) ); itr != idx.end() && itr->t_id == t_id->id; ++itr ) {
+         vector<char> data( itr->value.size() );
+         memcpy( data.data(), itr->value.data(), data.size() );
+         locks.push_back( abi_ser.binary_to_variant( "expiring_lock", data, abi_serializer_max_time ) );
+      }
+      return locks;
+   }
+
+   abi_serializer abi_ser;
+};
+
+BOOST_AUTO_TEST_SUITE(icp_token_tests)
+
+BOOST_FIXTURE_TEST_CASE( sweep_expired_refund_by_anyone, icp_token_tester ) try {
+
+   BOOST_REQUIRE_EQUAL( success(), icpreceive( N(alice), asset::from_string("100.0000 TKN") ) );
+   BOOST_REQUIRE_EQUAL( success(), icprefund( N(alice), asset::from_string("40.0000 TKN"), now() + 60 ) );
+   BOOST_REQUIRE_EQUAL( asset::from_string("60.0000 TKN"), get_balance( N(alice) ) );
+
+   auto locks = get_locks();
+   BOOST_REQUIRE_EQUAL( 1, locks.size() );
+   BOOST_REQUIRE_EQUAL( 1, locks[0]["refund"].as<uint8_t>() );
+   const uint64_t seq = locks[0]["seq"].as<uint64_t>();
+
+   produce_block( fc::seconds(120) );
+
+   // while its packet awaits a receipt the lock is only put off
+   BOOST_REQUIRE_EQUAL( success(), sweeplocked( N(bob), 10 ) );
+   locks = get_locks();
+   BOOST_REQUIRE_EQUAL( 1, locks.size() );
+   BOOST_TEST_REQUIRE( now() < locks[0]["expiration"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( asset::from_string("60.0000 TKN"), get_balance( N(alice) ) );
+
+   // once the packet is proven expired, anyone can mint the refund back
+   set_packet( seq, receipt_expired );
+   produce_block( fc::hours(1) );
+   BOOST_REQUIRE_EQUAL( success(), sweeplocked( N(bob), 10 ) );
+   BOOST_REQUIRE_EQUAL( 0, get_locks().size() );
+   BOOST_REQUIRE_EQUAL( asset::from_string("100.0000 TKN"), get_balance( N(alice) ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( sweep_skips_unsettled_locks, icp_token_tester ) try {
+
+   BOOST_REQUIRE_EQUAL( success(), icpreceive( N(alice), asset::from_string("100.0000 TKN") ) );
+   BOOST_REQUIRE_EQUAL( success(), icprefund( N(alice), asset::from_string("10.0000 TKN"), now() + 60 ) );
+   BOOST_REQUIRE_EQUAL( success(), icprefund( N(alice), asset::from_string("20.0000 TKN"), now() + 90 ) );
+
+   auto locks = get_locks();
+   BOOST_REQUIRE_EQUAL( 2, locks.size() );
+   const uint64_t first  = locks[0]["seq"].as<uint64_t>();
+   const uint64_t second = locks[1]["seq"].as<uint64_t>();
+   set_packet( second, receipt_expired );
+
+   produce_block( fc::seconds(120) );
+
+   // the first lock expires first but still awaits its receipt, so it does not use up the sweep
+   BOOST_REQUIRE_EQUAL( success(), sweeplocked( N(bob), 1 ) );
+   locks = get_locks();
+   BOOST_REQUIRE_EQUAL( 1, locks.size() );
+   BOOST_REQUIRE_EQUAL( first, locks[0]["seq"].as<uint64_t>() );
+   BOOST_REQUIRE_EQUAL( asset::from_string("90.0000 TKN"), get_balance( N(alice) ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
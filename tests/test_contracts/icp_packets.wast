@@ -0,0 +1,42 @@
+(module
+ (type $FUNCSIG$i (func (result i32)))
+ (type $FUNCSIG$iii (func (param i32 i32) (result i32)))
+ (type $FUNCSIG$ijjjj (func (param i64 i64 i64 i64) (result i32)))
+ (type $FUNCSIG$ijjjjii (func (param i64 i64 i64 i64 i32 i32) (result i32)))
+ (type $FUNCSIG$viji (func (param i32 i64 i32 i32)))
+ (import "env" "action_data_size" (func $action_data_size (result i32)))
+ (import "env" "read_action_data" (func $read_action_data (param i32 i32) (result i32)))
+ (import "env" "db_find_i64" (func $db_find_i64 (param i64 i64 i64 i64) (result i32)))
+ (import "env" "db_store_i64" (func $db_store_i64 (param i64 i64 i64 i64 i32 i32) (result i32)))
+ (import "env" "db_update_i64" (func $db_update_i64 (param i32 i64 i32 i32)))
+ (table 0 anyfunc)
+ (memory $0 1)
+ (export "memory" (memory $0))
+ (export "apply" (func $apply))
+ ;; stands in for the icp contract's `packets` table:
+ ;; `sendaction` stores a packet awaiting its receipt, i.e. {seq, 0, [], [], unknown, 0},
+ ;; `setpacket` stores its action data as the packet row keyed by the leading seq
+ (func $apply (param $0 i64) (param $1 i64) (param $2 i64)
+  (local $3 i32)
+  (local $4 i32)
+  (br_if 0 (i64.ne (get_local $1) (get_local $0)))
+  (set_local $3 (call $action_data_size))
+  (drop (call $read_action_data (i32.const 0) (get_local $3)))
+  (block $label$0
+   (block $label$1
+    (br_if $label$1 (i64.eq (get_local $2) (i64.const -4420684204901875712)))
+    (br_if $label$0 (i64.eq (get_local $2) (i64.const -4417095403845451776)))
+    (return)
+   )
+   (i64.store offset=8 (i32.const 0) (i64.const 0))
+   (set_local $3 (i32.const 16))
+  )
+  (set_local $4 (call $db_find_i64 (get_local $0) (get_local $0) (i64.const -6228190869736914944) (i64.load (i32.const 0))))
+  (block $label$2
+   (br_if $label$2 (i32.lt_s (get_local $4) (i32.const 0)))
+   (call $db_update_i64 (get_local $4) (get_local $0) (i32.const 0) (get_local $3))
+   (return)
+  )
+  (drop (call $db_store_i64 (get_local $0) (i64.const -6228190869736914944) (get_local $0) (i64.load (i32.const 0)) (i32.const 0) (get_local $3)))
+ )
+)
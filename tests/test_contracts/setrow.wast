@@ -0,0 +1,33 @@
+(module
+ (type $FUNCSIG$i (func (result i32)))
+ (type $FUNCSIG$iii (func (param i32 i32) (result i32)))
+ (type $FUNCSIG$ijjjj (func (param i64 i64 i64 i64) (result i32)))
+ (type $FUNCSIG$ijjjjii (func (param i64 i64 i64 i64 i32 i32) (result i32)))
+ (type $FUNCSIG$viji (func (param i32 i64 i32 i32)))
+ (import "env" "action_data_size" (func $action_data_size (result i32)))
+ (import "env" "read_action_data" (func $read_action_data (param i32 i32) (result i32)))
+ (import "env" "db_find_i64" (func $db_find_i64 (param i64 i64 i64 i64) (result i32)))
+ (import "env" "db_store_i64" (func $db_store_i64 (param i64 i64 i64 i64 i32 i32) (result i32)))
+ (import "env" "db_update_i64" (func $db_update_i64 (param i32 i64 i32 i32)))
+ (table 0 anyfunc)
+ (memory $0 1)
+ (export "memory" (memory $0))
+ (export "apply" (func $apply))
+ ;; `setrow` takes a table name followed by a packed row, and stores the row as is in that table
+ ;; of the receiver's own scope, keyed by the row's leading 8 bytes
+ (func $apply (param $0 i64) (param $1 i64) (param $2 i64)
+  (local $3 i32)
+  (local $4 i32)
+  (br_if 0 (i64.ne (get_local $1) (get_local $0)))
+  (br_if 0 (i64.ne (get_local $2) (i64.const -4417052188065398784)))
+  (set_local $3 (call $action_data_size))
+  (drop (call $read_action_data (i32.const 0) (get_local $3)))
+  (set_local $4 (call $db_find_i64 (get_local $0) (get_local $0) (i64.load (i32.const 0)) (i64.load offset=8 (i32.const 0))))
+  (block $label$0
+   (br_if $label$0 (i32.lt_s (get_local $4) (i32.const 0)))
+   (call $db_update_i64 (get_local $4) (get_local $0) (i32.const 8) (i32.sub (get_local $3) (i32.const 8)))
+   (return)
+  )
+  (drop (call $db_store_i64 (get_local $0) (i64.load (i32.const 0)) (get_local $0) (i64.load offset=8 (i32.const 0)) (i32.const 8) (i32.sub (get_local $3) (i32.const 8))))
+ )
+)